@@ -0,0 +1,323 @@
+#include "vulkan.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+// Renders every shader of a directory headless at a few fixed resolutions
+// with a fixed iTime step, and writes ms/frame percentiles, pipeline creation
+// time and peak device memory as JSON. With --baseline, the results are
+// compared against an earlier run and regressions fail the process.
+
+using nlohmann::json;
+
+namespace {
+
+struct Resolution {
+  uint32_t width, height;
+};
+
+struct BenchOptions {
+  std::string shaderDir = "Shaders";
+  std::vector<Resolution> resolutions = {
+      {640, 360}, {1280, 720}, {1920, 1080}};
+  uint32_t warmupFrames = 30;
+  uint32_t frames = 300;
+  float timeStep = 1.0f / 60.0f;
+  bool compute = false;
+  std::string outPath = "benchmark.json";
+  // Compare these results instead of running.
+  std::string resultsPath;
+  std::string baselinePath;
+  // Growth in percent that counts as a regression, for frame times,
+  // pipeline creation time (which is much noisier) and peak device memory.
+  double threshold = 5.0;
+  double pipelineThreshold = 25.0;
+  double memoryThreshold = 5.0;
+};
+
+BenchOptions parseBenchOptions(int argc, char **argv) {
+  BenchOptions options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::runtime_error(std::format("Missing value for {}.", arg));
+      }
+      return argv[++i];
+    };
+
+    if (arg == "--shaders") {
+      options.shaderDir = value();
+    } else if (arg == "--resolutions") {
+      // --resolutions 640x360,1920x1080
+      options.resolutions.clear();
+      std::stringstream list(value());
+      std::string spec;
+      while (std::getline(list, spec, ',')) {
+        auto x = spec.find('x');
+        if (x == std::string::npos) {
+          throw std::runtime_error(std::format("Bad resolution {}.", spec));
+        }
+        options.resolutions.push_back(
+            {static_cast<uint32_t>(std::stoul(spec.substr(0, x))),
+             static_cast<uint32_t>(std::stoul(spec.substr(x + 1)))});
+      }
+    } else if (arg == "--warmup") {
+      options.warmupFrames = std::stoul(value());
+    } else if (arg == "--frames") {
+      options.frames = std::stoul(value());
+    } else if (arg == "--time-step") {
+      options.timeStep = std::stof(value());
+    } else if (arg == "--compute") {
+      options.compute = true;
+    } else if (arg == "--out") {
+      options.outPath = value();
+    } else if (arg == "--results") {
+      options.resultsPath = value();
+    } else if (arg == "--baseline") {
+      options.baselinePath = value();
+    } else if (arg == "--threshold") {
+      options.threshold = std::stod(value());
+    } else if (arg == "--pipeline-threshold") {
+      options.pipelineThreshold = std::stod(value());
+    } else if (arg == "--memory-threshold") {
+      options.memoryThreshold = std::stod(value());
+    } else {
+      throw std::runtime_error(std::format("Unknown option {}.", arg));
+    }
+  }
+  if (options.frames == 0 || options.frames > Profiler::windowSize) {
+    throw std::runtime_error(std::format(
+        "Measured frames must be between 1 and {}.", Profiler::windowSize));
+  }
+  return options;
+}
+
+json percentilesJson(std::optional<Profiler::Percentiles> times) {
+  if (!times) {
+    return nullptr;
+  }
+  return {{"p50", times->p50}, {"p95", times->p95}, {"p99", times->p99}};
+}
+
+json measure(VulkanApp &app, const BenchOptions &bench,
+             const std::string &shader, Resolution resolution, json &device) {
+  app.init();
+  if (device.is_null()) {
+    auto properties = app.deviceProperties();
+    device = {{"name", std::string(properties.deviceName.data())},
+              {"vendorId", properties.vendorID},
+              {"deviceId", properties.deviceID},
+              {"driverVersion", properties.driverVersion}};
+  }
+
+  for (uint32_t i = 0; i < bench.warmupFrames; i++) {
+    app.drawFrame();
+  }
+  app.finishFrames();
+  auto &profiler = app.frameProfiler();
+  profiler.resetStats();
+
+  // CPU time per drawFrame(), which with frames in flight is the frame
+  // interval once the GPU is the bottleneck.
+  std::optional<uint64_t> peakMemory = app.deviceMemoryUsage();
+  for (uint32_t i = 0; i < bench.frames; i++) {
+    {
+      Profiler::CpuScope scope(profiler, "drawFrame");
+      app.drawFrame();
+    }
+    if (auto usage = app.deviceMemoryUsage()) {
+      peakMemory = std::max(peakMemory.value_or(0), *usage);
+    }
+  }
+  app.finishFrames();
+
+  return {{"shader", shader},
+          {"width", resolution.width},
+          {"height", resolution.height},
+          {"gpuMs", percentilesJson(profiler.percentiles("frame", true))},
+          {"cpuMs", percentilesJson(profiler.percentiles("drawFrame", false))},
+          {"pipelineMs", app.pipelineCreationMs()},
+          {"peakDeviceMemory",
+           peakMemory ? json(*peakMemory) : json(nullptr)}};
+}
+
+json runShader(const BenchOptions &bench, const std::string &shader,
+               Resolution resolution, json &device) {
+  AppOptions options;
+  options.headless = true;
+  options.width = resolution.width;
+  options.height = resolution.height;
+  options.fragmentShader = shader;
+  options.computeImage = bench.compute;
+  options.timeStep = bench.timeStep;
+  options.profile = true;
+  // Measure cold pipeline creation; compiled SPIR-V may still come from the
+  // shader cache.
+  options.pipelineCacheDir.clear();
+
+  VulkanApp app(options);
+  json result;
+  try {
+    result = measure(app, bench, shader, resolution, device);
+  } catch (...) {
+    // Release the instance and device before the next shader runs.
+    app.cleanup();
+    throw;
+  }
+  app.cleanup();
+  return result;
+}
+
+json runAll(const BenchOptions &bench) {
+  std::vector<std::string> shaders;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(bench.shaderDir)) {
+    auto extension = entry.path().extension();
+    bool shader = extension == ".spv" || extension == ".glsl" ||
+                  extension == ".frag";
+    if (entry.is_regular_file() && shader) {
+      shaders.push_back(entry.path().generic_string());
+    }
+  }
+  std::sort(shaders.begin(), shaders.end());
+  if (shaders.empty()) {
+    throw std::runtime_error(
+        std::format("No shaders in {}.", bench.shaderDir));
+  }
+
+  json device;
+  json results = json::array();
+  for (const auto &shader : shaders) {
+    for (auto resolution : bench.resolutions) {
+      std::cerr << std::format("[bench] {} {}x{}\n", shader, resolution.width,
+                               resolution.height);
+      try {
+        results.push_back(runShader(bench, shader, resolution, device));
+      } catch (const std::exception &e) {
+        std::cerr << std::format("[bench] Failed: {}\n", e.what());
+        results.push_back({{"shader", shader},
+                           {"width", resolution.width},
+                           {"height", resolution.height},
+                           {"error", e.what()}});
+      }
+    }
+  }
+  return {{"device", device},
+          {"warmupFrames", bench.warmupFrames},
+          {"frames", bench.frames},
+          {"timeStep", bench.timeStep},
+          {"compute", bench.compute},
+          {"results", results}};
+}
+
+json readJson(const std::string &path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::runtime_error(std::format("Open {} failed.", path));
+  }
+  return json::parse(file);
+}
+
+// GPU times where both runs have them, CPU frame times otherwise.
+const char *frameTimesKey(const json &a, const json &b) {
+  for (const char *key : {"gpuMs", "cpuMs"}) {
+    if (a.contains(key) && !a[key].is_null() && b.contains(key) &&
+        !b[key].is_null()) {
+      return key;
+    }
+  }
+  return nullptr;
+}
+
+bool compare(const json &current, const json &baseline,
+             const BenchOptions &bench) {
+  if (current["device"] != baseline["device"]) {
+    std::cout << "[compare] Note: results come from different devices or "
+                 "drivers\n";
+  }
+  bool regressed = false;
+  for (const auto &result : current["results"]) {
+    auto name = std::format("{} {}x{}", result["shader"].get<std::string>(),
+                            result["width"].get<uint32_t>(),
+                            result["height"].get<uint32_t>());
+    auto old = std::find_if(
+        baseline["results"].begin(), baseline["results"].end(),
+        [&](const json &entry) {
+          return entry["shader"] == result["shader"] &&
+                 entry["width"] == result["width"] &&
+                 entry["height"] == result["height"];
+        });
+    if (old == baseline["results"].end()) {
+      std::cout << std::format("[compare] {}: new\n", name);
+      continue;
+    }
+    if (result.contains("error")) {
+      std::cout << std::format("[compare] {}: FAILED {}\n", name,
+                               result["error"].get<std::string>());
+      regressed = true;
+      continue;
+    }
+    const auto check = [&](const std::string &metric, double a, double b,
+                           double threshold, const char *unit) {
+      double change = a > 0.0 ? (b - a) / a * 100.0 : 0.0;
+      bool worse = change > threshold;
+      regressed |= worse;
+      std::cout << std::format("[compare] {}: {} {:.3f} -> {:.3f} {} "
+                               "({:+.1f}%){}\n",
+                               name, metric, a, b, unit, change,
+                               worse ? " REGRESSION" : "");
+    };
+    if (const char *key = frameTimesKey(result, *old)) {
+      for (const char *percentile : {"p50", "p95"}) {
+        check(std::format("{} {}", key, percentile), (*old)[key][percentile],
+              result[key][percentile], bench.threshold, "ms");
+      }
+    }
+    const auto both = [&](const char *key) {
+      return result.contains(key) && !result[key].is_null() &&
+             old->contains(key) && !(*old)[key].is_null();
+    };
+    if (both("pipelineMs")) {
+      check("pipelineMs", (*old)["pipelineMs"], result["pipelineMs"],
+            bench.pipelineThreshold, "ms");
+    }
+    if (both("peakDeviceMemory")) {
+      const double mib = 1024.0 * 1024.0;
+      check("peakDeviceMemory",
+            (*old)["peakDeviceMemory"].get<double>() / mib,
+            result["peakDeviceMemory"].get<double>() / mib,
+            bench.memoryThreshold, "MiB");
+    }
+  }
+  return !regressed;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  try {
+    auto bench = parseBenchOptions(argc, argv);
+    json current;
+    if (bench.resultsPath.empty()) {
+      current = runAll(bench);
+      std::ofstream out(bench.outPath, std::ios::trunc);
+      out << current.dump(2) << "\n";
+      std::cerr << std::format("[bench] Wrote {}\n", bench.outPath);
+    } else {
+      current = readJson(bench.resultsPath);
+    }
+    if (!bench.baselinePath.empty() &&
+        !compare(current, readJson(bench.baselinePath), bench)) {
+      return 1;
+    }
+  } catch (const std::exception &e) {
+    std::cout << std::format("{}\n", e.what());
+    return 2;
+  }
+  return 0;
+}
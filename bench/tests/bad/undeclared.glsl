@@ -0,0 +1,4 @@
+// Doesn't compile: the benchmark must report it as an error result.
+void mainImage(out vec4 fragColor, in vec2 fragCoord) {
+  fragColor = vec4(undeclared, 1.0);
+}
@@ -0,0 +1,113 @@
+#include "accumulator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <iostream>
+
+Accumulator::Accumulator(const Context &context, vk::Extent2D extent,
+                         uint32_t maxSamples, float noiseThreshold)
+    : device(context.device), allocator(context.allocator), extent(extent),
+      maxSamples(maxSamples), noiseThreshold(noiseThreshold) {
+  if (noiseThreshold <= 0.0f) {
+    return;
+  }
+  buffer = device.createBuffer(
+      vk::BufferCreateInfo()
+          .setSize(vk::DeviceSize(extent.width) * extent.height * 4 *
+                   sizeof(float))
+          .setUsage(vk::BufferUsageFlagBits::eTransferDst)
+          .setSharingMode(vk::SharingMode::eExclusive));
+  memory = allocator->allocateBuffer(buffer,
+                                     vk::MemoryPropertyFlagBits::eHostVisible,
+                                     vk::MemoryPropertyFlagBits::eHostCached);
+}
+
+Accumulator::~Accumulator() {
+  device.destroyBuffer(buffer);
+  allocator->free(memory);
+}
+
+void Accumulator::reset() {
+  samples = 0;
+  converged = false;
+  done = false;
+  generation++;
+}
+
+bool Accumulator::finishing() const {
+  return !done && (converged || (maxSamples && samples + 1 >= maxSamples));
+}
+
+void Accumulator::collect(uint32_t slot) {
+  if (!readback.pending || readback.slot != slot) {
+    return;
+  }
+  readback.pending = false;
+  if (readback.generation != generation) {
+    return;
+  }
+  allocator->invalidate(memory);
+  noise = estimateNoise(readback.samples);
+  converged = noise <= noiseThreshold;
+}
+
+bool Accumulator::wantsReadback() const {
+  return buffer && !readback.pending && !converged &&
+         (samples + 1) % checkInterval == 0;
+}
+
+void Accumulator::recordReadback(vk::CommandBuffer commandBuffer,
+                                 uint32_t slot, vk::Image sum) {
+  auto region =
+      vk::BufferImageCopy()
+          .setImageSubresource(vk::ImageSubresourceLayers(
+              vk::ImageAspectFlagBits::eColor, 0, 0, 1))
+          .setImageExtent(vk::Extent3D(extent.width, extent.height, 1));
+  commandBuffer.copyImageToBuffer(sum, vk::ImageLayout::eTransferSrcOptimal,
+                                  buffer, region);
+  auto toHost = vk::BufferMemoryBarrier()
+                    .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                    .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+                    .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                    .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                    .setBuffer(buffer)
+                    .setSize(VK_WHOLE_SIZE);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eHost, {}, nullptr,
+                                toHost, nullptr);
+  readback = {.pending = true,
+              .slot = slot,
+              .samples = samples + 1,
+              .generation = generation};
+}
+
+void Accumulator::advance() {
+  if (finishing()) {
+    done = true;
+    std::cerr << std::format("[accumulate] Done after {} samples{}\n",
+                             samples + 1,
+                             converged ? std::format(", noise {:.4f}", noise)
+                                       : std::string());
+    return;
+  }
+  samples++;
+}
+
+// The per-pixel variance of the mean is the luminance variance over the
+// sample count; its image average against the average luminance gives a
+// single relative error.
+double Accumulator::estimateNoise(uint32_t sampleCount) const {
+  const auto *sums = reinterpret_cast<const float *>(memory.data);
+  const std::size_t pixels = std::size_t(extent.width) * extent.height;
+  const double n = sampleCount;
+  double variance = 0.0, luminance = 0.0;
+  for (std::size_t i = 0; i < pixels; i++) {
+    const float *sum = sums + i * 4;
+    const double mean =
+        (0.2126 * sum[0] + 0.7152 * sum[1] + 0.0722 * sum[2]) / n;
+    const double meanSquare = sum[3] / n;
+    variance += std::max(meanSquare - mean * mean, 0.0) / n;
+    luminance += mean;
+  }
+  return std::sqrt(variance / pixels) / std::max(luminance / pixels, 1e-4);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "memory_allocator.hpp"
+#include <cstdint>
+#include <vulkan/vulkan.hpp>
+
+// Progressive accumulation of a Monte Carlo shader: which sample the frame
+// being recorded adds, and when to stop adding them. The running sum holds
+// the RGB sums and, in alpha, the sum of squared luminance, from which the
+// noise of the mean is estimated. The sum is read back every few samples
+// with at most one readback in flight, collected once its frame slot's fence
+// has been waited on, so the estimate never stalls the render loop.
+class Accumulator {
+public:
+  struct Context {
+    vk::Device device;
+    MemoryAllocator *allocator;
+  };
+
+  // Samples between two noise estimates.
+  static constexpr uint32_t checkInterval = 16;
+
+  // Zero `maxSamples` or `noiseThreshold` disables that stopping criterion.
+  // The threshold is the standard error of the mean luminance relative to
+  // the mean luminance, over the whole image.
+  Accumulator(const Context &context, vk::Extent2D extent,
+              uint32_t maxSamples, float noiseThreshold);
+  ~Accumulator();
+
+  Accumulator(const Accumulator &) = delete;
+  Accumulator &operator=(const Accumulator &) = delete;
+
+  // Starts over from the first sample, e.g. after the view changed.
+  void reset();
+  // The sample the next frame adds, counting from zero.
+  uint32_t sample() const { return samples; }
+  // The next frame completes the image: it reaches the sample budget or the
+  // last estimate was under the threshold.
+  bool finishing() const;
+  // The image is complete; nothing is added until reset().
+  bool finished() const { return done; }
+
+  // Called once the slot's fence has been waited on.
+  void collect(uint32_t slot);
+  bool wantsReadback() const;
+  // Copies the running sum, in TransferSrcOptimal, for a noise estimate.
+  void recordReadback(vk::CommandBuffer commandBuffer, uint32_t slot,
+                      vk::Image sum);
+  // The next frame was submitted.
+  void advance();
+
+private:
+  double estimateNoise(uint32_t sampleCount) const;
+
+  vk::Device device;
+  MemoryAllocator *allocator;
+  vk::Extent2D extent;
+  uint32_t maxSamples;
+  float noiseThreshold;
+
+  uint32_t samples = 0;
+  bool converged = false;
+  bool done = false;
+  double noise = 0.0;
+  // Bumped by reset(), so a readback of an older sum is ignored.
+  uint64_t generation = 0;
+
+  vk::Buffer buffer;
+  Allocation memory;
+  struct {
+    bool pending = false;
+    uint32_t slot = 0;
+    uint32_t samples = 0;
+    uint64_t generation = 0;
+  } readback;
+};
@@ -0,0 +1,136 @@
+#include "batch.hpp"
+#include "vulkan.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Job {
+  uint32_t line;
+  std::vector<std::string> args;
+};
+
+// Whitespace separated, with double quotes around arguments containing
+// spaces.
+std::vector<std::string> splitArgs(const std::string &text) {
+  std::vector<std::string> args;
+  std::string current;
+  bool quoted = false, pending = false;
+  for (char c : text) {
+    if (c == '"') {
+      quoted = !quoted;
+      pending = true;
+    } else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+      if (pending) {
+        args.push_back(std::move(current));
+        current.clear();
+        pending = false;
+      }
+    } else {
+      current += c;
+      pending = true;
+    }
+  }
+  if (quoted) {
+    throw std::runtime_error("Unterminated quote.");
+  }
+  if (pending) {
+    args.push_back(std::move(current));
+  }
+  return args;
+}
+
+std::vector<Job> loadJobs(const std::string &path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::runtime_error(std::format("Open {} failed.", path));
+  }
+  std::vector<Job> jobs;
+  std::string text;
+  for (uint32_t line = 1; std::getline(file, text); line++) {
+    auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos || text[first] == '#') {
+      continue;
+    }
+    try {
+      jobs.push_back(Job{line, splitArgs(text)});
+    } catch (const std::exception &e) {
+      throw std::runtime_error(
+          std::format("{} line {}: {}", path, line, e.what()));
+    }
+  }
+  return jobs;
+}
+
+AppOptions jobOptions(int argc, char **argv, const Job &job) {
+  std::vector<char *> args(argv, argv + argc);
+  for (const auto &arg : job.args) {
+    args.push_back(const_cast<char *>(arg.c_str()));
+  }
+  return parseOptions(static_cast<int>(args.size()), args.data());
+}
+
+} // namespace
+
+int runBatch(const AppOptions &options, int argc, char **argv) {
+  const auto jobs = loadJobs(options.batchPath);
+  const auto threads = std::min<uint32_t>(
+      options.batchThreads
+          ? options.batchThreads
+          : std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u),
+      std::max<std::size_t>(jobs.size(), 1));
+
+  const auto start = std::chrono::steady_clock::now();
+  VulkanApp owner(options);
+  owner.initDevice();
+
+  std::atomic<std::size_t> next = 0;
+  std::atomic<int> failed = 0;
+  const auto work = [&]() {
+    for (auto index = next++; index < jobs.size(); index = next++) {
+      const auto &job = jobs[index];
+      try {
+        VulkanApp app(jobOptions(argc, argv, job), owner);
+        try {
+          app.init();
+          app.mainLoop();
+        } catch (...) {
+          // Give back whatever the job created; the device lives on.
+          app.cleanup();
+          throw;
+        }
+        app.cleanup();
+      } catch (const std::exception &e) {
+        failed++;
+        std::cerr << std::format("[batch] {} line {}: {}\n",
+                                 options.batchPath, job.line, e.what());
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < threads; i++) {
+    workers.emplace_back(work);
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  owner.destroyDevice();
+
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  std::cout << std::format(
+      "[batch] {} jobs ({} failed) on {} threads in {:.1f} s, {:.0f} "
+      "jobs/hour\n",
+      jobs.size(), failed.load(), threads, seconds,
+      seconds > 0.0 ? jobs.size() * 3600.0 / seconds : 0.0);
+  return failed;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "options.hpp"
+
+// Renders every job listed in options.batchPath on one Vulkan device, so the
+// instance, device, allocator and pipeline/shader caches are set up once for
+// the whole list. Each line holds one job's options (shader, size, frames,
+// --first-frame, channels, --export ...) as they would be passed on the
+// command line after the process's own arguments; blank lines and lines
+// starting with '#' are skipped. Jobs run concurrently on worker threads,
+// each with its own command pool, render graph and pipelines, so one job
+// compiles its shaders and pipelines while others are rendering. Returns the
+// number of failed jobs.
+int runBatch(const AppOptions &options, int argc, char **argv);
@@ -0,0 +1,411 @@
+#include "frame_exporter.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+FrameExporter::FrameExporter(const Context &context, vk::Extent2D extent,
+                             vk::Format imageFormat, const std::string &path,
+                             uint32_t ringSize, uint32_t workerCount,
+                             uint32_t fps, vk::Extent2D imageExtent)
+    : device(context.device), allocator(context.allocator), extent(extent),
+      format(formatFor(path)), path(path), fps(fps),
+      imageExtent(imageExtent) {
+  switch (imageFormat) {
+  case vk::Format::eR8G8B8A8Unorm:
+  case vk::Format::eR8G8B8A8Srgb:
+    break;
+  case vk::Format::eB8G8R8A8Unorm:
+  case vk::Format::eB8G8R8A8Srgb:
+    swapRedBlue = true;
+    break;
+  default:
+    throw std::runtime_error("Frame export needs an 8-bit RGBA/BGRA target.");
+  }
+  frameSize = vk::DeviceSize(extent.width) * extent.height * 4;
+  if (imageExtent.width) {
+    if (format != Format::Raw && format != Format::Ppm) {
+      throw std::runtime_error(
+          "Tiled export needs a .rgba, .raw or .ppm file.");
+    }
+    tileColumns = (imageExtent.width + extent.width - 1) / extent.width;
+  }
+
+  if (format == Format::Png && path.find('{') == std::string::npos) {
+    // One file per frame: out.png -> out_000000.png.
+    auto file = std::filesystem::path(path);
+    this->path = (file.parent_path() / (file.stem().string() + "_{:06}" +
+                                        file.extension().string()))
+                     .string();
+  }
+  if (format != Format::Png) {
+    stream.open(path, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open()) {
+      throw std::runtime_error(std::format("Open {} failed.", path));
+    }
+  }
+  if (format == Format::Y4m) {
+    stream << std::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C420jpeg\n",
+                          extent.width, extent.height, fps);
+  }
+  if (tileColumns && format == Format::Ppm) {
+    stream << std::format("P6\n{} {}\n255\n", imageExtent.width,
+                          imageExtent.height);
+    headerSize = stream.tellp();
+  }
+
+  slots.resize(ringSize);
+  for (auto &slot : slots) {
+    slot.buffer = device.createBuffer(
+        vk::BufferCreateInfo()
+            .setSize(frameSize)
+            .setUsage(vk::BufferUsageFlagBits::eTransferDst)
+            .setSharingMode(vk::SharingMode::eExclusive));
+    // Cached memory makes the CPU reads much faster where it exists.
+    slot.memory = allocator->allocateBuffer(
+        slot.buffer, vk::MemoryPropertyFlagBits::eHostVisible,
+        vk::MemoryPropertyFlagBits::eHostCached);
+  }
+
+  workerCount = std::max(workerCount, 1u);
+  for (uint32_t i = 0; i < workerCount; i++) {
+    workers.emplace_back(&FrameExporter::work, this);
+  }
+}
+
+FrameExporter::~FrameExporter() {
+  // Runs during cleanup and unwinding, where a throw would terminate.
+  try {
+    flush();
+  } catch (const std::exception &e) {
+    std::cerr << std::format("[export] Flush failed: {}\n", e.what());
+  }
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  jobQueued.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (auto &slot : slots) {
+    device.destroyBuffer(slot.buffer);
+    allocator->free(slot.memory);
+  }
+}
+
+FrameExporter::Format FrameExporter::formatFor(const std::string &path) {
+  auto extension = std::filesystem::path(path).extension().string();
+  if (extension == ".png") {
+    return Format::Png;
+  }
+  if (extension == ".y4m") {
+    return Format::Y4m;
+  }
+  if (extension == ".ppm") {
+    return Format::Ppm;
+  }
+  if (extension == ".rgba" || extension == ".raw") {
+    return Format::Raw;
+  }
+  throw std::runtime_error(
+      std::format("Unknown export format {} (png, rgba, raw, ppm or y4m).",
+                  path));
+}
+
+uint32_t FrameExporter::acquire() {
+  while (true) {
+    poll();
+    {
+      std::unique_lock lock(mutex);
+      for (uint32_t i = 0; i < slots.size(); i++) {
+        if (!slots[i].busy) {
+          slots[i].busy = true;
+          return i;
+        }
+      }
+      if (pending.empty()) {
+        // Everything is with the workers.
+        slotFreed.wait(lock);
+        continue;
+      }
+    }
+    // Everything not with the workers is still on the GPU.
+    if (device.waitForFences(pending.front().fence, VK_TRUE, UINT64_MAX) !=
+        vk::Result::eSuccess) {
+      throw std::runtime_error("Wait for exported frame failed.");
+    }
+  }
+}
+
+void FrameExporter::recordCopy(vk::CommandBuffer commandBuffer, uint32_t slot,
+                               vk::Image image, vk::ImageLayout layout) {
+  const auto colorRange =
+      vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+  auto toTransfer =
+      vk::ImageMemoryBarrier()
+          .setOldLayout(layout)
+          .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
+          .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite |
+                            vk::AccessFlagBits::eTransferWrite)
+          .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+          .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+          .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+          .setImage(image)
+          .setSubresourceRange(colorRange);
+  commandBuffer.pipelineBarrier(
+      vk::PipelineStageFlagBits::eColorAttachmentOutput |
+          vk::PipelineStageFlagBits::eTransfer,
+      vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, toTransfer);
+
+  auto region =
+      vk::BufferImageCopy()
+          .setImageSubresource(vk::ImageSubresourceLayers(
+              vk::ImageAspectFlagBits::eColor, 0, 0, 1))
+          .setImageExtent(vk::Extent3D(extent.width, extent.height, 1));
+  commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal,
+                                  slots[slot].buffer, region);
+
+  auto toHost = vk::BufferMemoryBarrier()
+                    .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                    .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+                    .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                    .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                    .setBuffer(slots[slot].buffer)
+                    .setSize(VK_WHOLE_SIZE);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eHost, {}, nullptr,
+                                toHost, nullptr);
+
+  if (layout != vk::ImageLayout::eTransferSrcOptimal) {
+    auto back = vk::ImageMemoryBarrier()
+                    .setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+                    .setNewLayout(layout)
+                    .setSrcAccessMask(vk::AccessFlagBits::eTransferRead)
+                    .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                    .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                    .setImage(image)
+                    .setSubresourceRange(colorRange);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eBottomOfPipe, {},
+                                  nullptr, nullptr, back);
+  }
+}
+
+void FrameExporter::submitted(uint32_t slot, uint64_t frame, vk::Fence fence) {
+  if (firstFrame) {
+    std::lock_guard lock(mutex);
+    nextStreamFrame = frame;
+    firstTileFrame = frame;
+    firstFrame = false;
+  }
+  pending.push_back(Pending{slot, frame, fence});
+}
+
+void FrameExporter::poll() {
+  while (!pending.empty() &&
+         device.getFenceStatus(pending.front().fence) == vk::Result::eSuccess) {
+    handOff(pending.front());
+    pending.pop_front();
+  }
+}
+
+void FrameExporter::flush() {
+  for (const auto &entry : pending) {
+    if (device.waitForFences(entry.fence, VK_TRUE, UINT64_MAX) !=
+        vk::Result::eSuccess) {
+      throw std::runtime_error("Wait for exported frame failed.");
+    }
+    handOff(entry);
+  }
+  pending.clear();
+
+  std::unique_lock lock(mutex);
+  slotFreed.wait(lock, [this]() {
+    return std::none_of(slots.begin(), slots.end(),
+                        [](const Slot &slot) { return slot.busy; });
+  });
+}
+
+void FrameExporter::handOff(const Pending &entry) {
+  {
+    std::lock_guard lock(mutex);
+    jobs.push_back(Job{entry.slot, entry.frame});
+  }
+  jobQueued.notify_one();
+}
+
+void FrameExporter::work() {
+  std::vector<uint8_t> scratch;
+  while (true) {
+    Job job;
+    {
+      std::unique_lock lock(mutex);
+      jobQueued.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+      job = jobs.front();
+      jobs.pop_front();
+    }
+
+    try {
+      encode(job, scratch);
+    } catch (const std::exception &e) {
+      std::cerr << std::format("[export] Frame {}: {}\n", job.frame, e.what());
+      if (format != Format::Png && !tileColumns) {
+        // Keep the stream moving for the frames behind this one.
+        writeInOrder(job.frame, {});
+      }
+    }
+
+    {
+      std::lock_guard lock(mutex);
+      slots[job.slot].busy = false;
+    }
+    slotFreed.notify_all();
+  }
+}
+
+void FrameExporter::encode(const Job &job, std::vector<uint8_t> &scratch) {
+  const auto &slot = slots[job.slot];
+  allocator->invalidate(slot.memory);
+
+  const uint8_t *rgba = slot.memory.data;
+  if (swapRedBlue) {
+    scratch.assign(rgba, rgba + frameSize);
+    for (std::size_t i = 0; i < frameSize; i += 4) {
+      std::swap(scratch[i], scratch[i + 2]);
+    }
+    rgba = scratch.data();
+  }
+
+  if (tileColumns) {
+    writeTile(job.frame, rgba);
+    return;
+  }
+
+  const auto width = extent.width, height = extent.height;
+  switch (format) {
+  case Format::Png: {
+    auto file = std::vformat(path, std::make_format_args(job.frame));
+    if (!stbi_write_png(file.c_str(), width, height, 4, rgba, width * 4)) {
+      throw std::runtime_error(std::format("Write {} failed.", file));
+    }
+    break;
+  }
+  case Format::Raw:
+    writeInOrder(job.frame, std::vector<uint8_t>(rgba, rgba + frameSize));
+    break;
+  case Format::Ppm: {
+    // Each frame is a complete P6 image; netpbm tools read them in sequence.
+    auto header = std::format("P6\n{} {}\n255\n", width, height);
+    std::vector<uint8_t> bytes(header.begin(), header.end());
+    bytes.reserve(header.size() + frameSize / 4 * 3);
+    for (std::size_t i = 0; i < frameSize; i += 4) {
+      bytes.insert(bytes.end(), rgba + i, rgba + i + 3);
+    }
+    writeInOrder(job.frame, bytes);
+    break;
+  }
+  case Format::Y4m: {
+    // Full range BT.601 (C420jpeg), chroma averaged over 2x2 blocks.
+    const uint32_t chromaWidth = (width + 1) / 2;
+    const uint32_t chromaHeight = (height + 1) / 2;
+    std::vector<uint8_t> yuv(width * height + 2 * chromaWidth * chromaHeight);
+    uint8_t *y = yuv.data();
+    uint8_t *u = y + width * height;
+    uint8_t *v = u + chromaWidth * chromaHeight;
+    const auto clamp = [](float value) {
+      return static_cast<uint8_t>(std::clamp(value + 0.5f, 0.0f, 255.0f));
+    };
+    for (uint32_t row = 0; row < height; row++) {
+      for (uint32_t col = 0; col < width; col++) {
+        const uint8_t *p = rgba + (row * width + col) * 4;
+        y[row * width + col] = clamp(0.299f * p[0] + 0.587f * p[1] +
+                                     0.114f * p[2]);
+      }
+    }
+    for (uint32_t row = 0; row < chromaHeight; row++) {
+      for (uint32_t col = 0; col < chromaWidth; col++) {
+        float r = 0, g = 0, b = 0;
+        int count = 0;
+        for (uint32_t dy = 0; dy < 2 && row * 2 + dy < height; dy++) {
+          for (uint32_t dx = 0; dx < 2 && col * 2 + dx < width; dx++) {
+            const uint8_t *p =
+                rgba + ((row * 2 + dy) * width + col * 2 + dx) * 4;
+            r += p[0], g += p[1], b += p[2];
+            count++;
+          }
+        }
+        r /= count, g /= count, b /= count;
+        u[row * chromaWidth + col] =
+            clamp(128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+        v[row * chromaWidth + col] =
+            clamp(128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+      }
+    }
+    writeInOrder(job.frame, yuv);
+    break;
+  }
+  }
+}
+
+void FrameExporter::writeInOrder(uint64_t frame,
+                                 const std::vector<uint8_t> &bytes) {
+  std::unique_lock lock(mutex);
+  turnChanged.wait(lock, [&]() { return nextStreamFrame == frame; });
+  if (!bytes.empty()) {
+    if (format == Format::Y4m) {
+      stream << "FRAME\n";
+    }
+    stream.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+  }
+  nextStreamFrame++;
+  lock.unlock();
+  turnChanged.notify_all();
+}
+
+void FrameExporter::writeTile(uint64_t frame, const uint8_t *rgba) {
+  const uint64_t tile = frame - firstTileFrame;
+  const uint64_t x = tile % tileColumns * extent.width;
+  const uint64_t y = tile / tileColumns * extent.height;
+  if (y >= imageExtent.height) {
+    return;
+  }
+  // Edge tiles reach past the image.
+  const auto columns =
+      static_cast<uint32_t>(std::min<uint64_t>(extent.width,
+                                               imageExtent.width - x));
+  const auto rows =
+      static_cast<uint32_t>(std::min<uint64_t>(extent.height,
+                                               imageExtent.height - y));
+  const uint32_t channels = format == Format::Ppm ? 3 : 4;
+
+  std::vector<uint8_t> packed(std::size_t(columns) * rows * channels);
+  for (uint32_t row = 0; row < rows; row++) {
+    const uint8_t *source = rgba + std::size_t(row) * extent.width * 4;
+    uint8_t *target = packed.data() + std::size_t(row) * columns * channels;
+    for (uint32_t col = 0; col < columns; col++) {
+      std::copy_n(source + col * 4, channels, target + col * channels);
+    }
+  }
+
+  std::lock_guard lock(tileMutex);
+  for (uint32_t row = 0; row < rows; row++) {
+    stream.seekp(headerSize +
+                 static_cast<std::streamoff>(
+                     ((y + row) * imageExtent.width + x) * channels));
+    stream.write(
+        reinterpret_cast<const char *>(packed.data()) +
+            std::size_t(row) * columns * channels,
+        std::streamsize(columns) * channels);
+  }
+  if (!stream) {
+    throw std::runtime_error(std::format("Write {} failed.", path));
+  }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "memory_allocator.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// Streams rendered frames to disk without stalling the render loop. Each
+// frame is copied into one slot of a ring of persistently mapped host-visible
+// buffers; once the frame's fence has signalled, the slot goes to a pool of
+// workers that encode it (PNG per frame, or raw RGBA / PPM / Y4M streams
+// written in frame order). The render thread only blocks when every slot is
+// busy. Frames can also be the tiles of one larger image, in which case each
+// tile is written straight to its place in a raw or PPM file, so host memory
+// never holds more than the ring.
+class FrameExporter {
+public:
+  enum class Format { Png, Raw, Ppm, Y4m };
+
+  struct Context {
+    vk::Device device;
+    MemoryAllocator *allocator;
+  };
+
+  // A non-zero `imageExtent` makes frames the tiles of an image that size,
+  // `extent` each, in row-major order starting with the first frame.
+  FrameExporter(const Context &context, vk::Extent2D extent,
+                vk::Format imageFormat, const std::string &path,
+                uint32_t ringSize, uint32_t workerCount, uint32_t fps,
+                vk::Extent2D imageExtent = {});
+  ~FrameExporter();
+
+  FrameExporter(const FrameExporter &) = delete;
+  FrameExporter &operator=(const FrameExporter &) = delete;
+
+  // Returns a free ring slot, waiting for the GPU or the workers if needed.
+  uint32_t acquire();
+  // Copies a finished colour image (in `layout`, written as a colour
+  // attachment or by a blit) into the slot and puts it back into `layout`.
+  void recordCopy(vk::CommandBuffer commandBuffer, uint32_t slot,
+                  vk::Image image, vk::ImageLayout layout);
+  // The frame in `slot` was submitted with `fence`.
+  void submitted(uint32_t slot, uint64_t frame, vk::Fence fence);
+  // Hands every slot whose fence has signalled to the workers. Must be called
+  // before a fence passed to submitted() is reset.
+  void poll();
+  // Waits until every submitted frame has been written.
+  void flush();
+
+  static Format formatFor(const std::string &path);
+
+private:
+  struct Slot {
+    vk::Buffer buffer;
+    Allocation memory;
+    bool busy = false;
+  };
+
+  struct Pending {
+    uint32_t slot;
+    uint64_t frame;
+    vk::Fence fence;
+  };
+
+  struct Job {
+    uint32_t slot;
+    uint64_t frame;
+  };
+
+  void handOff(const Pending &pending);
+  void work();
+  void encode(const Job &job, std::vector<uint8_t> &scratch);
+  void writeInOrder(uint64_t frame, const std::vector<uint8_t> &bytes);
+  void writeTile(uint64_t frame, const uint8_t *rgba);
+
+  vk::Device device;
+  MemoryAllocator *allocator;
+  vk::Extent2D extent;
+  bool swapRedBlue = false;
+  Format format;
+  std::string path;
+  uint32_t fps;
+  vk::DeviceSize frameSize;
+
+  std::vector<Slot> slots;
+  std::deque<Pending> pending;
+
+  std::mutex mutex;
+  std::condition_variable slotFreed, jobQueued, turnChanged;
+  std::deque<Job> jobs;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+
+  // Streams are written strictly in frame order.
+  std::ofstream stream;
+  uint64_t nextStreamFrame = 0;
+  bool firstFrame = true;
+
+  vk::Extent2D imageExtent;
+  uint32_t tileColumns = 0;
+  uint64_t firstTileFrame = 0;
+  std::streamoff headerSize = 0;
+  // Tiles land anywhere in the file, one write at a time.
+  std::mutex tileMutex;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a. Only used to key caches, not for anything security related.
+inline uint64_t hashBytes(const void *data, std::size_t size,
+                          uint64_t seed = 0xcbf29ce484222325ull) {
+  auto bytes = static_cast<const unsigned char *>(data);
+  uint64_t hash = seed;
+  for (std::size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+inline uint64_t hashCombine(uint64_t seed, uint64_t value) {
+  return hashBytes(&value, sizeof(value), seed);
+}
@@ -1,10 +1,15 @@
+#include "batch.hpp"
 #include "vulkan.hpp"
 #include <format>
 #include <iostream>
 
-int main() {
-  VulkanApp app;
+int main(int argc, char **argv) {
   try {
+    auto options = parseOptions(argc, argv);
+    if (!options.batchPath.empty()) {
+      return runBatch(options, argc, argv) == 0 ? 0 : 1;
+    }
+    VulkanApp app(options);
     app.run();
   } catch (const std::exception &e) {
     using std::cout;
@@ -0,0 +1,353 @@
+#include "memory_allocator.hpp"
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Smallest range a block hands out; smaller requests are rounded up.
+const vk::DeviceSize minNodeSize = 256;
+
+double mebibytes(vk::DeviceSize bytes) {
+  return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+} // namespace
+
+MemoryAllocator::MemoryAllocator(vk::PhysicalDevice gpu, vk::Device device,
+                                 vk::DeviceSize blockSize)
+    : device(device), memoryProperties(gpu.getMemoryProperties()),
+      blockSize(std::bit_ceil(std::max(blockSize, minNodeSize))) {
+  const auto limits = gpu.getProperties().limits;
+  nonCoherentAtomSize = limits.nonCoherentAtomSize;
+  // Ranges are at least minNodeSize apart already.
+  separateTiling = limits.bufferImageGranularity > minNodeSize;
+  maxOrder = static_cast<uint32_t>(std::countr_zero(this->blockSize) -
+                                   std::countr_zero(minNodeSize));
+  typeStats.resize(memoryProperties.memoryTypeCount);
+}
+
+MemoryAllocator::~MemoryAllocator() {
+  auto live = totals().allocations;
+  if (live > 0) {
+    std::cerr << std::format("[memory] {} allocations still live\n", live);
+  }
+  for (uint32_t i = 0; i < blocks.size(); i++) {
+    if (blocks[i].memory) {
+      destroyBlock(i);
+    }
+  }
+}
+
+uint32_t MemoryAllocator::findMemoryType(
+    uint32_t typeBits, vk::MemoryPropertyFlags required,
+    vk::MemoryPropertyFlags preferred) const {
+  std::optional<uint32_t> fallback;
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    const auto flags = memoryProperties.memoryTypes[i].propertyFlags;
+    if (!(typeBits & (1u << i)) || (flags & required) != required) {
+      continue;
+    }
+    if ((flags & preferred) == preferred) {
+      return i;
+    }
+    if (!fallback) {
+      fallback = i;
+    }
+  }
+  if (!fallback) {
+    throw std::runtime_error("No suitable memory type.");
+  }
+  return *fallback;
+}
+
+Allocation MemoryAllocator::allocate(const vk::MemoryRequirements &requirements,
+                                     vk::MemoryPropertyFlags required,
+                                     vk::MemoryPropertyFlags preferred,
+                                     Tiling tiling) {
+  Allocation allocation;
+  allocation.memoryType =
+      findMemoryType(requirements.memoryTypeBits, required, preferred);
+
+  // Buddy ranges are aligned to their size, so covering the alignment is
+  // enough to satisfy it.
+  const auto size = std::max(requirements.size, requirements.alignment);
+  if (size > blockSize / 2) {
+    allocation.memory = device.allocateMemory(
+        vk::MemoryAllocateInfo()
+            .setAllocationSize(requirements.size)
+            .setMemoryTypeIndex(allocation.memoryType));
+    allocation.size = requirements.size;
+    allocation.data = map(allocation.memory, allocation.memoryType);
+
+    std::lock_guard lock(mutex);
+    auto &type = typeStats[allocation.memoryType];
+    type.dedicated++;
+    type.allocations++;
+    type.reserved += allocation.size;
+    type.used += allocation.size;
+    peakReserved = std::max(peakReserved, totals().reserved);
+    return allocation;
+  }
+
+  const auto order = orderFor(size);
+  std::lock_guard lock(mutex);
+  std::optional<vk::DeviceSize> offset;
+  for (uint32_t i = 0; i < blocks.size() && !offset; i++) {
+    auto &block = blocks[i];
+    if (block.memory && block.memoryType == allocation.memoryType &&
+        (!separateTiling || block.tiling == tiling)) {
+      offset = takeNode(block, order);
+      allocation.block = i;
+    }
+  }
+  if (!offset) {
+    allocation.block = createBlock(allocation.memoryType, tiling);
+    offset = takeNode(blocks[allocation.block], order);
+  }
+
+  auto &block = blocks[allocation.block];
+  block.allocations++;
+  allocation.memory = block.memory;
+  allocation.offset = *offset;
+  allocation.size = minNodeSize << order;
+  allocation.data = block.data ? block.data + *offset : nullptr;
+
+  auto &type = typeStats[allocation.memoryType];
+  type.allocations++;
+  type.used += allocation.size;
+  return allocation;
+}
+
+Allocation MemoryAllocator::allocateImage(vk::Image image,
+                                          vk::MemoryPropertyFlags required,
+                                          vk::MemoryPropertyFlags preferred) {
+  auto allocation = allocate(device.getImageMemoryRequirements(image),
+                             required, preferred, Tiling::Optimal);
+  device.bindImageMemory(image, allocation.memory, allocation.offset);
+  return allocation;
+}
+
+Allocation MemoryAllocator::allocateBuffer(vk::Buffer buffer,
+                                           vk::MemoryPropertyFlags required,
+                                           vk::MemoryPropertyFlags preferred) {
+  auto allocation = allocate(device.getBufferMemoryRequirements(buffer),
+                             required, preferred, Tiling::Linear);
+  device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+  return allocation;
+}
+
+void MemoryAllocator::free(const Allocation &allocation) {
+  if (!allocation) {
+    return;
+  }
+  std::lock_guard lock(mutex);
+  auto &type = typeStats[allocation.memoryType];
+  type.allocations--;
+  type.used -= allocation.size;
+  if (allocation.block == UINT32_MAX) {
+    device.freeMemory(allocation.memory);
+    type.dedicated--;
+    type.reserved -= allocation.size;
+    return;
+  }
+
+  // Merge with the buddy for as long as it is free too.
+  auto &block = blocks[allocation.block];
+  auto offset = allocation.offset;
+  auto order = orderFor(allocation.size);
+  for (; order < maxOrder; order++) {
+    auto buddy = block.freeLists[order].find(offset ^ (minNodeSize << order));
+    if (buddy == block.freeLists[order].end()) {
+      break;
+    }
+    offset = std::min(offset, *buddy);
+    block.freeLists[order].erase(buddy);
+  }
+  block.freeLists[order].insert(offset);
+
+  // Keep one empty block per kind around so a free/allocate pair doesn't go
+  // back to the driver.
+  if (--block.allocations == 0) {
+    auto spare = std::any_of(blocks.begin(), blocks.end(), [&](auto &other) {
+      return &other != &block && other.memory &&
+             other.memoryType == block.memoryType &&
+             other.tiling == block.tiling;
+    });
+    if (spare) {
+      destroyBlock(allocation.block);
+    }
+  }
+}
+
+bool MemoryAllocator::isCoherent(const Allocation &allocation) const {
+  return static_cast<bool>(
+      memoryProperties.memoryTypes[allocation.memoryType].propertyFlags &
+      vk::MemoryPropertyFlagBits::eHostCoherent);
+}
+
+void MemoryAllocator::invalidate(const Allocation &allocation) const {
+  if (isCoherent(allocation)) {
+    return;
+  }
+  auto range = vk::MappedMemoryRange(allocation.memory, 0, VK_WHOLE_SIZE);
+  if (allocation.block != UINT32_MAX) {
+    // Blocks are a power of two no smaller than the atom, so the aligned
+    // range stays inside the block.
+    auto begin = allocation.offset / nonCoherentAtomSize * nonCoherentAtomSize;
+    auto end = (allocation.offset + allocation.size + nonCoherentAtomSize - 1) /
+               nonCoherentAtomSize * nonCoherentAtomSize;
+    range.setOffset(begin).setSize(std::min(end, blockSize) - begin);
+  }
+  device.invalidateMappedMemoryRanges(range);
+}
+
+MemoryAllocator::Stats MemoryAllocator::stats() const {
+  std::lock_guard lock(mutex);
+  return totals();
+}
+
+MemoryAllocator::Stats MemoryAllocator::totals() const {
+  Stats total;
+  for (const auto &type : typeStats) {
+    total.blocks += type.blocks;
+    total.dedicated += type.dedicated;
+    total.allocations += type.allocations;
+    total.reserved += type.reserved;
+    total.used += type.used;
+  }
+  total.peakReserved = std::max(peakReserved, total.reserved);
+  return total;
+}
+
+void MemoryAllocator::report(std::ostream &out) const {
+  std::lock_guard lock(mutex);
+  for (uint32_t i = 0; i < typeStats.size(); i++) {
+    const auto &type = typeStats[i];
+    if (type.reserved == 0) {
+      continue;
+    }
+    out << std::format(
+        "[memory] type {:2} {:<36} {:3} blocks {:3} dedicated "
+        "{:9.1f} / {:9.1f} MiB in {} allocations\n",
+        i, vk::to_string(memoryProperties.memoryTypes[i].propertyFlags),
+        type.blocks, type.dedicated, mebibytes(type.used),
+        mebibytes(type.reserved), type.allocations);
+  }
+  out << std::format("[memory] peak {:.1f} MiB\n", mebibytes(peakReserved));
+}
+
+uint32_t MemoryAllocator::orderFor(vk::DeviceSize size) const {
+  auto node = std::bit_ceil(std::max(size, minNodeSize));
+  return static_cast<uint32_t>(std::countr_zero(node) -
+                               std::countr_zero(minNodeSize));
+}
+
+std::optional<vk::DeviceSize> MemoryAllocator::takeNode(Block &block,
+                                                        uint32_t order) {
+  auto from = order;
+  while (from <= maxOrder && block.freeLists[from].empty()) {
+    from++;
+  }
+  if (from > maxOrder) {
+    return std::nullopt;
+  }
+  auto offset = *block.freeLists[from].begin();
+  block.freeLists[from].erase(block.freeLists[from].begin());
+  // Split down, keeping the lower half and freeing the upper one.
+  for (; from > order; from--) {
+    block.freeLists[from - 1].insert(offset + (minNodeSize << (from - 1)));
+  }
+  return offset;
+}
+
+uint32_t MemoryAllocator::createBlock(uint32_t memoryType, Tiling tiling) {
+  auto unused = std::find_if(blocks.begin(), blocks.end(),
+                             [](const Block &block) { return !block.memory; });
+  auto index = static_cast<uint32_t>(unused - blocks.begin());
+  if (unused == blocks.end()) {
+    blocks.emplace_back();
+  }
+
+  auto &block = blocks[index];
+  block.memory = device.allocateMemory(vk::MemoryAllocateInfo()
+                                           .setAllocationSize(blockSize)
+                                           .setMemoryTypeIndex(memoryType));
+  block.memoryType = memoryType;
+  block.tiling = tiling;
+  block.data = map(block.memory, memoryType);
+  block.allocations = 0;
+  block.freeLists.assign(maxOrder + 1, {});
+  block.freeLists[maxOrder].insert(0);
+
+  auto &type = typeStats[memoryType];
+  type.blocks++;
+  type.reserved += blockSize;
+  peakReserved = std::max(peakReserved, totals().reserved);
+  return index;
+}
+
+void MemoryAllocator::destroyBlock(uint32_t index) {
+  auto &block = blocks[index];
+  device.freeMemory(block.memory);
+  block.memory = nullptr;
+  block.data = nullptr;
+  block.freeLists.clear();
+  auto &type = typeStats[block.memoryType];
+  type.blocks--;
+  type.reserved -= blockSize;
+}
+
+uint8_t *MemoryAllocator::map(vk::DeviceMemory memory, uint32_t memoryType) {
+  if (!(memoryProperties.memoryTypes[memoryType].propertyFlags &
+        vk::MemoryPropertyFlagBits::eHostVisible)) {
+    return nullptr;
+  }
+  return static_cast<uint8_t *>(device.mapMemory(memory, 0, VK_WHOLE_SIZE));
+}
+
+std::optional<vk::DeviceSize>
+RingAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+  const auto align = [alignment](vk::DeviceSize offset) {
+    return (offset + alignment - 1) / alignment * alignment;
+  };
+  vk::DeviceSize offset = 0;
+  if (!ranges.empty()) {
+    const auto end = ranges.back().offset + ranges.back().size;
+    const auto tail = ranges.front().offset;
+    if (end > tail) {
+      // Free space after the newest range, then before the oldest one.
+      offset = align(end);
+      if (offset + size > capacity) {
+        offset = 0;
+        if (size > tail) {
+          return std::nullopt;
+        }
+      }
+    } else {
+      offset = align(end);
+      if (offset + size > tail) {
+        return std::nullopt;
+      }
+    }
+  } else if (size > capacity) {
+    return std::nullopt;
+  }
+  ranges.push_back(Range{offset, std::max<vk::DeviceSize>(size, 1)});
+  return offset;
+}
+
+void RingAllocator::release(vk::DeviceSize offset) {
+  auto range = std::find_if(ranges.begin(), ranges.end(),
+                            [&](const Range &entry) {
+                              return entry.offset == offset && !entry.released;
+                            });
+  if (range != ranges.end()) {
+    range->released = true;
+  }
+  while (!ranges.empty() && ranges.front().released) {
+    ranges.pop_front();
+  }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <set>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// A range of device memory handed out by MemoryAllocator. Host-visible
+// memory stays mapped for the allocation's whole lifetime.
+struct Allocation {
+  vk::DeviceMemory memory;
+  vk::DeviceSize offset = 0;
+  vk::DeviceSize size = 0;
+  uint8_t *data = nullptr;
+  uint32_t memoryType = 0;
+  // Owning block, or UINT32_MAX for a dedicated allocation.
+  uint32_t block = UINT32_MAX;
+
+  explicit operator bool() const { return static_cast<bool>(memory); }
+};
+
+// Sub-allocates long-lived resources from large blocks, one set of blocks
+// per memory type, so the number of vkAllocateMemory calls stays far below
+// maxMemoryAllocationCount. Each block is a buddy allocator: ranges are
+// power-of-two sized and aligned, which keeps frees and merges cheap and
+// fragmentation bounded. Buffers and linear images never share a block with
+// optimally tiled images, which keeps them bufferImageGranularity apart.
+// Requests larger than half a block get memory of their own. Safe to use
+// from several threads.
+class MemoryAllocator {
+public:
+  enum class Tiling { Linear, Optimal };
+
+  struct Stats {
+    uint32_t blocks = 0;
+    uint32_t dedicated = 0;
+    uint32_t allocations = 0;
+    // Memory held from the driver, and the part of it handed out.
+    vk::DeviceSize reserved = 0;
+    vk::DeviceSize used = 0;
+    vk::DeviceSize peakReserved = 0;
+  };
+
+  MemoryAllocator(vk::PhysicalDevice gpu, vk::Device device,
+                  vk::DeviceSize blockSize = vk::DeviceSize(64) << 20);
+  ~MemoryAllocator();
+
+  MemoryAllocator(const MemoryAllocator &) = delete;
+  MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+
+  // The first memory type in `typeBits` with all `required` flags, preferring
+  // one that also has the `preferred` ones.
+  uint32_t findMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags required,
+                          vk::MemoryPropertyFlags preferred = {}) const;
+
+  Allocation allocate(const vk::MemoryRequirements &requirements,
+                      vk::MemoryPropertyFlags required,
+                      vk::MemoryPropertyFlags preferred, Tiling tiling);
+  // Allocate and bind.
+  Allocation allocateImage(vk::Image image, vk::MemoryPropertyFlags required,
+                           vk::MemoryPropertyFlags preferred = {});
+  Allocation allocateBuffer(vk::Buffer buffer,
+                            vk::MemoryPropertyFlags required,
+                            vk::MemoryPropertyFlags preferred = {});
+  // Accepts an empty allocation.
+  void free(const Allocation &allocation);
+
+  bool isCoherent(const Allocation &allocation) const;
+  // Makes GPU writes visible to the host; a no-op on coherent memory.
+  void invalidate(const Allocation &allocation) const;
+
+  Stats stats() const;
+  // One line per memory type in use.
+  void report(std::ostream &out) const;
+
+private:
+  struct Block {
+    vk::DeviceMemory memory;
+    uint32_t memoryType = 0;
+    Tiling tiling = Tiling::Optimal;
+    uint8_t *data = nullptr;
+    uint32_t allocations = 0;
+    // Free offsets of every order; order k ranges are minNodeSize << k.
+    std::vector<std::set<vk::DeviceSize>> freeLists;
+  };
+
+  struct TypeStats {
+    uint32_t blocks = 0;
+    uint32_t dedicated = 0;
+    uint32_t allocations = 0;
+    vk::DeviceSize reserved = 0;
+    vk::DeviceSize used = 0;
+  };
+
+  // Callers hold the mutex.
+  Stats totals() const;
+  uint32_t orderFor(vk::DeviceSize size) const;
+  std::optional<vk::DeviceSize> takeNode(Block &block, uint32_t order);
+  uint32_t createBlock(uint32_t memoryType, Tiling tiling);
+  void destroyBlock(uint32_t block);
+  uint8_t *map(vk::DeviceMemory memory, uint32_t memoryType);
+
+  vk::Device device;
+  vk::PhysicalDeviceMemoryProperties memoryProperties;
+  vk::DeviceSize blockSize;
+  vk::DeviceSize nonCoherentAtomSize;
+  bool separateTiling;
+  uint32_t maxOrder;
+
+  mutable std::mutex mutex;
+  std::vector<Block> blocks;
+  std::vector<TypeStats> typeStats;
+  vk::DeviceSize peakReserved = 0;
+};
+
+// Hands out ranges of a fixed-size region in FIFO order, for staging data
+// that is retired roughly in the order it was written (per frame or per
+// upload). Ranges may be released in any order; their space is reused once
+// every older range has been released as well. Not thread-safe.
+class RingAllocator {
+public:
+  explicit RingAllocator(vk::DeviceSize capacity = 0) : capacity(capacity) {}
+
+  vk::DeviceSize size() const { return capacity; }
+  std::optional<vk::DeviceSize> allocate(vk::DeviceSize size,
+                                         vk::DeviceSize alignment);
+  void release(vk::DeviceSize offset);
+
+private:
+  struct Range {
+    vk::DeviceSize offset, size;
+    bool released = false;
+  };
+
+  vk::DeviceSize capacity;
+  std::deque<Range> ranges;
+};
@@ -0,0 +1,309 @@
+#include "options.hpp"
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+ValidationSeverity parseValidationSeverity(const std::string &name) {
+  if (name == "error") {
+    return ValidationSeverity::Error;
+  }
+  if (name == "warning") {
+    return ValidationSeverity::Warning;
+  }
+  if (name == "info") {
+    return ValidationSeverity::Info;
+  }
+  if (name == "verbose") {
+    return ValidationSeverity::Verbose;
+  }
+  throw std::runtime_error(
+      std::format("Unknown validation severity {}.", name));
+}
+
+uint32_t parseValidationTypes(const std::string &list) {
+  // validation,performance
+  const auto items = list + ",";
+  uint32_t types = 0;
+  for (std::size_t start = 0; start < items.size();) {
+    const auto comma = items.find(',', start);
+    const auto type = items.substr(start, comma - start);
+    start = comma + 1;
+    if (type == "general") {
+      types |= 1;
+    } else if (type == "validation") {
+      types |= 2;
+    } else if (type == "performance") {
+      types |= 4;
+    } else {
+      throw std::runtime_error(
+          std::format("Unknown validation message type {}.", type));
+    }
+  }
+  return types;
+}
+
+void loadValidationConfig(const std::string &path,
+                          ValidationSeverity &severity, uint32_t &types) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::runtime_error(std::format("Open {} failed.", path));
+  }
+  const auto trim = [](const std::string &text) {
+    const auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+      return std::string();
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+  };
+  std::string line;
+  for (uint32_t number = 1; std::getline(file, line); number++) {
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    const auto equals = line.find('=');
+    const auto key = trim(line.substr(0, equals));
+    const auto value =
+        equals == std::string::npos ? "" : trim(line.substr(equals + 1));
+    if (key == "severity") {
+      severity = parseValidationSeverity(value);
+    } else if (key == "types") {
+      types = parseValidationTypes(value);
+    } else {
+      throw std::runtime_error(std::format(
+          "{} line {}: expected severity= or types=.", path, number));
+    }
+  }
+}
+
+AppOptions parseOptions(int argc, char **argv) {
+  AppOptions options;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::runtime_error(std::format("Missing value for {}.", arg));
+      }
+      return argv[++i];
+    };
+    const auto number = [&]() {
+      return static_cast<uint32_t>(std::stoul(value()));
+    };
+
+    if (arg == "--headless") {
+      options.headless = true;
+    } else if (arg == "--width") {
+      options.width = number();
+    } else if (arg == "--height") {
+      options.height = number();
+    } else if (arg == "--frames") {
+      options.frames = number();
+    } else if (arg == "--first-frame") {
+      options.firstFrame = number();
+    } else if (arg == "--frames-in-flight") {
+      options.framesInFlight = number();
+    } else if (arg == "--present-mode") {
+      auto mode = value();
+      if (mode == "fifo") {
+        options.presentMode = PresentMode::Fifo;
+      } else if (mode == "fifo-relaxed") {
+        options.presentMode = PresentMode::FifoRelaxed;
+      } else if (mode == "mailbox") {
+        options.presentMode = PresentMode::Mailbox;
+      } else if (mode == "immediate") {
+        options.presentMode = PresentMode::Immediate;
+      } else {
+        throw std::runtime_error(std::format("Unknown present mode {}.", mode));
+      }
+    } else if (arg == "--swapchain-images") {
+      options.swapchainImages = number();
+    } else if (arg == "--fps") {
+      options.targetFps = number();
+    } else if (arg == "--continuous") {
+      options.continuous = true;
+    } else if (arg == "--dynamic-resolution") {
+      options.targetFrameMs = std::stof(value());
+    } else if (arg == "--min-scale") {
+      options.minScale = std::stof(value());
+    } else if (arg == "--time-step") {
+      options.timeStep = std::stof(value());
+    } else if (arg == "--vertex") {
+      options.vertexShader = value();
+    } else if (arg == "--fragment") {
+      options.fragmentShader = value();
+    } else if (arg == "--buffer") {
+      // --buffer a=path
+      auto spec = value();
+      if (spec.size() < 3 || spec[0] < 'a' || spec[0] > 'd' ||
+          spec[1] != '=') {
+        throw std::runtime_error(std::format("Bad buffer spec {}.", spec));
+      }
+      options.buffers[spec[0] - 'a'].shader = spec.substr(2);
+    } else if (arg == "--channel") {
+      // --channel image:0=a, --channel b:1=b
+      auto spec = value();
+      auto colon = spec.find(':');
+      auto equals = spec.find('=');
+      if (colon == std::string::npos || equals != colon + 2 ||
+          spec[colon + 1] < '0' || spec[colon + 1] > '3') {
+        throw std::runtime_error(std::format("Bad channel spec {}.", spec));
+      }
+      auto pass = spec.substr(0, colon);
+      auto channel = spec[colon + 1] - '0';
+      auto source = spec.substr(equals + 1);
+      if (pass == "image") {
+        options.channels[channel] = source;
+      } else if (pass.size() == 1 && pass[0] >= 'a' && pass[0] <= 'd') {
+        options.buffers[pass[0] - 'a'].channels[channel] = source;
+      } else {
+        throw std::runtime_error(std::format("Bad channel spec {}.", spec));
+      }
+    } else if (arg == "--compute") {
+      // --compute image, --compute a, --compute all
+      auto pass = value();
+      if (pass == "image" || pass == "all") {
+        options.computeImage = true;
+      }
+      if (pass.size() == 1 && pass[0] >= 'a' && pass[0] <= 'd') {
+        options.buffers[pass[0] - 'a'].compute = true;
+      } else if (pass == "all") {
+        for (auto &buffer : options.buffers) {
+          buffer.compute = true;
+        }
+      } else if (pass != "image") {
+        throw std::runtime_error(std::format("Bad compute pass {}.", pass));
+      }
+    } else if (arg == "--workgroup") {
+      // --workgroup 16x8
+      auto spec = value();
+      auto x = spec.find('x');
+      if (x == std::string::npos) {
+        throw std::runtime_error(std::format("Bad workgroup size {}.", spec));
+      }
+      options.workgroupWidth = std::stoul(spec.substr(0, x));
+      options.workgroupHeight = std::stoul(spec.substr(x + 1));
+    } else if (arg == "--accumulate") {
+      options.accumulate = true;
+    } else if (arg == "--max-samples") {
+      options.maxSamples = number();
+    } else if (arg == "--noise-threshold") {
+      options.noiseThreshold = std::stof(value());
+      options.accumulate = true;
+    } else if (arg == "--spec") {
+      // --spec STEPS=64
+      auto spec = value();
+      auto equals = spec.find('=');
+      if (equals == 0 || equals == std::string::npos) {
+        throw std::runtime_error(
+            std::format("Bad specialization constant {}.", spec));
+      }
+      options.specValues[spec.substr(0, equals)] = spec.substr(equals + 1);
+    } else if (arg == "--spec-config") {
+      options.specConfig = value();
+    } else if (arg == "--quality") {
+      options.qualityTier = value();
+    } else if (arg == "--profile") {
+      options.profile = true;
+    } else if (arg == "--trace") {
+      options.tracePath = value();
+      options.profile = true;
+    } else if (arg == "--export") {
+      options.exportPath = value();
+    } else if (arg == "--tile") {
+      options.tileSize = number();
+    } else if (arg == "--export-ring") {
+      options.exportRing = number();
+    } else if (arg == "--export-threads") {
+      options.exportThreads = number();
+    } else if (arg == "--export-fps") {
+      options.exportFps = number();
+    } else if (arg == "--batch") {
+      options.batchPath = value();
+    } else if (arg == "--batch-threads") {
+      options.batchThreads = number();
+    } else if (arg == "--watch") {
+      options.watchShaders = true;
+    } else if (arg == "--validation") {
+      options.validationSeverity = parseValidationSeverity(value());
+    } else if (arg == "--validation-types") {
+      options.validationTypes = parseValidationTypes(value());
+    } else if (arg == "--validation-config") {
+      options.validationConfig = value();
+    } else if (arg == "--validation-repeats") {
+      options.validationRepeats = number();
+    } else if (arg == "--pipeline-cache") {
+      options.pipelineCacheDir = value();
+    } else if (arg == "--no-pipeline-cache") {
+      options.pipelineCacheDir.clear();
+    } else if (arg == "--shader-cache") {
+      options.shaderCacheDir = value();
+    } else if (arg == "--no-shader-cache") {
+      options.shaderCacheDir.clear();
+    } else {
+      throw std::runtime_error(std::format("Unknown option {}.", arg));
+    }
+  }
+
+  if (!options.batchPath.empty()) {
+    options.headless = true;
+  }
+  if (options.width == 0 || options.height == 0) {
+    throw std::runtime_error("Render size must not be zero.");
+  }
+  if (options.framesInFlight == 0) {
+    throw std::runtime_error("Need at least one frame in flight.");
+  }
+  if (options.minScale <= 0.0f || options.minScale > 1.0f) {
+    throw std::runtime_error("Minimum scale must be in (0, 1].");
+  }
+  if (options.workgroupWidth == 0 || options.workgroupHeight == 0) {
+    throw std::runtime_error("Workgroup size must not be zero.");
+  }
+  if (options.exportFps == 0) {
+    throw std::runtime_error("Export frame rate must not be zero.");
+  }
+  if (options.accumulate) {
+    if (options.tileSize || options.targetFrameMs > 0.0f) {
+      throw std::runtime_error("Accumulation can't be combined with tiled "
+                               "rendering or dynamic resolution.");
+    }
+    if (options.headless) {
+      options.maxSamples = options.maxSamples
+                               ? std::min(options.maxSamples, options.frames)
+                               : options.frames;
+    } else if (!options.exportPath.empty() && !options.maxSamples &&
+               options.noiseThreshold <= 0.0f) {
+      throw std::runtime_error("Exporting an accumulated image needs "
+                               "--max-samples or --noise-threshold.");
+    }
+  }
+  if (!options.qualityTier.empty() && options.specConfig.empty()) {
+    throw std::runtime_error("A quality tier needs --spec-config.");
+  }
+  if (options.tileSize) {
+    if (!options.headless || options.exportPath.empty()) {
+      throw std::runtime_error(
+          "Tiled rendering needs --headless and --export.");
+    }
+    for (const auto &buffer : options.buffers) {
+      if (!buffer.shader.empty()) {
+        // A buffer pass would only ever see its own tile of the last frame.
+        throw std::runtime_error(
+            "Tiled rendering supports the Image pass only.");
+      }
+    }
+    if (options.targetFrameMs > 0.0f) {
+      throw std::runtime_error(
+          "Tiled rendering can't be combined with dynamic resolution.");
+    }
+    const uint32_t columns =
+        (options.width + options.tileSize - 1) / options.tileSize;
+    const uint32_t rows =
+        (options.height + options.tileSize - 1) / options.tileSize;
+    options.frames = columns * rows;
+  }
+  return options;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+
+enum class PresentMode { Fifo, FifoRelaxed, Mailbox, Immediate };
+enum class ValidationSeverity { Error, Warning, Info, Verbose };
+
+struct PassOptions {
+  std::string shader;
+  // iChannel0-3 sources: "a" to "d" for buffer passes, an image file,
+  // "cube:PATH" with "{}" in PATH for the face (0-5), "volume:PATH" for a
+  // ShaderToy .bin volume, or empty for none.
+  std::array<std::string, 4> channels;
+  // Run mainImage() as a compute dispatch instead of a full-screen draw.
+  bool compute = false;
+};
+
+struct AppOptions {
+  bool headless = false;
+  uint32_t width = 800;
+  uint32_t height = 600;
+  uint32_t frames = 60;
+  // iFrame (and the fixed-step iTime) of the first frame, so a long
+  // animation can be split into ranges.
+  uint32_t firstFrame = 0;
+  uint32_t framesInFlight = 2;
+  // Falls back to FIFO when the surface doesn't offer the mode.
+  PresentMode presentMode = PresentMode::Fifo;
+  // Zero picks one more than the surface minimum.
+  uint32_t swapchainImages = 0;
+  // Caps the frame rate by sleeping before each frame; zero doesn't pace.
+  uint32_t targetFps = 0;
+  // Windows whose shaders read neither time nor frame inputs nor a feedback
+  // buffer are only redrawn after window and input events; this redraws
+  // them every frame regardless.
+  bool continuous = false;
+  // GPU frame time in milliseconds that the Image pass's render scale
+  // adapts to, never going below minScale; zero renders at full size.
+  float targetFrameMs = 0.0f;
+  float minScale = 0.5f;
+  // Adds every frame's Image pass output to a running fp32 sum and shows
+  // the average, with iSample counting the samples and iTime held. Stops
+  // after maxSamples (headless: at most `frames`) or once the estimated
+  // relative noise falls below noiseThreshold; zero disables either.
+  // Windowed, the finished image stays up until the mouse, the window or a
+  // shader changes, and then accumulation starts over.
+  bool accumulate = false;
+  uint32_t maxSamples = 0;
+  float noiseThreshold = 0.0f;
+  // Fixed iTime step per frame, for reproducible output; zero follows the
+  // wall clock.
+  float timeStep = 0.0f;
+  // Either SPIR-V (.spv) or GLSL; a GLSL fragment shader may be a ShaderToy
+  // style mainImage() source. An empty vertex shader uses the built-in
+  // full-screen triangle.
+  std::string vertexShader;
+  std::string fragmentShader = "Shaders/fragement.spv";
+  // Channels of the Image pass, and ShaderToy's Buffer A-D passes.
+  std::array<std::string, 4> channels;
+  std::array<PassOptions, 4> buffers;
+  bool computeImage = false;
+  uint32_t workgroupWidth = 8;
+  uint32_t workgroupHeight = 8;
+  // Specialization constant values by name or constant_id. The config file
+  // gives defaults and per-tier sections (see loadSpecConfig), which
+  // qualityTier selects; values given with --spec win over both.
+  std::map<std::string, std::string> specValues;
+  std::string specConfig;
+  std::string qualityTier;
+  // Validation layer output of debug builds: messages of at least this
+  // severity and of these types (VkDebugUtilsMessageTypeFlagsEXT bits: 1
+  // general, 2 validation, 4 performance). Each message ID is printed at
+  // most validationRepeats times and only counted after that. The config
+  // file (see loadValidationConfig) overrides severity and types, and is
+  // re-read whenever it changes.
+  ValidationSeverity validationSeverity = ValidationSeverity::Warning;
+  uint32_t validationTypes = 7;
+  uint32_t validationRepeats = 3;
+  std::string validationConfig;
+  // Empty disables the on-disk pipeline cache.
+  std::string pipelineCacheDir = "PipelineCache";
+  std::string shaderCacheDir = "ShaderCache";
+  bool watchShaders = false;
+  // Print per-phase and per-pass timings and device memory use at exit. The
+  // trace gets every sample, as CSV for a .csv path and Chrome trace JSON
+  // otherwise.
+  bool profile = false;
+  std::string tracePath;
+  // Frames are written to .png (one file per frame, "{}" in the path is the
+  // frame number), .rgba/.raw or .y4m. Zero ring size and thread count pick
+  // a default.
+  std::string exportPath;
+  // Renders a single still of width x height as square tiles of this size,
+  // one per frame, each written straight into its place in a .rgba/.raw or
+  // .ppm export. Headless and Image pass only; zero renders whole frames.
+  uint32_t tileSize = 0;
+  uint32_t exportRing = 0;
+  uint32_t exportThreads = 0;
+  uint32_t exportFps = 60;
+  // One job per line, each the command-line options of a headless run on top
+  // of the process's own. Jobs share one device and run concurrently on
+  // batchThreads threads; zero picks a default.
+  std::string batchPath;
+  uint32_t batchThreads = 0;
+};
+
+AppOptions parseOptions(int argc, char **argv);
+
+ValidationSeverity parseValidationSeverity(const std::string &name);
+// A comma-separated list of general, validation and performance.
+uint32_t parseValidationTypes(const std::string &list);
+// Reads "severity = warning" and "types = validation,performance" lines,
+// either of which may be left out; '#' starts a comment.
+void loadValidationConfig(const std::string &path,
+                          ValidationSeverity &severity, uint32_t &types);
@@ -0,0 +1,185 @@
+#include "pipeline_cache.hpp"
+#include "hash.hpp"
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace {
+
+const uint32_t blobMagic = 0x54534B56; // "VKST"
+const uint32_t blobVersion = 1;
+
+struct BlobHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  // Fills what would otherwise be padding, so the header is written without
+  // uninitialized bytes.
+  uint32_t reserved;
+  uint64_t pipelineKey;
+  uint64_t dataSize;
+  uint64_t dataHash;
+};
+static_assert(std::has_unique_object_representations_v<BlobHeader>);
+
+} // namespace
+
+PipelineCache::PipelineCache(vk::PhysicalDevice gpu, vk::Device device,
+                             std::string directory)
+    : device(device), properties(gpu.getProperties()),
+      directory(std::move(directory)) {
+  deviceKey = hashBytes(properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+  deviceKey = hashCombine(deviceKey, properties.vendorID);
+  deviceKey = hashCombine(deviceKey, properties.deviceID);
+  deviceKey = hashCombine(deviceKey, properties.driverVersion);
+}
+
+vk::PipelineCache PipelineCache::get(uint64_t pipelineKey) {
+  std::lock_guard lock(mutex);
+  if (auto it = caches.find(pipelineKey); it != caches.end()) {
+    return it->second.cache;
+  }
+
+  auto blob = load(pipelineKey);
+  auto createInfo = vk::PipelineCacheCreateInfo();
+  Entry entry;
+  if (!blob.empty()) {
+    BlobHeader header;
+    std::memcpy(&header, blob.data(), sizeof(header));
+    entry.savedSize = header.dataSize;
+    entry.savedHash = header.dataHash;
+    createInfo.setInitialDataSize(blob.size() - sizeof(BlobHeader))
+        .setPInitialData(blob.data() + sizeof(BlobHeader));
+  }
+  entry.cache = device.createPipelineCache(createInfo);
+  caches.emplace(pipelineKey, entry);
+  return entry.cache;
+}
+
+void PipelineCache::save() {
+  std::lock_guard lock(mutex);
+  if (directory.empty()) {
+    return;
+  }
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+
+  for (auto &[pipelineKey, entry] : caches) {
+    auto data = device.getPipelineCacheData(entry.cache);
+    const auto dataHash = hashBytes(data.data(), data.size());
+    // Unchanged since it was loaded or last saved.
+    if (data.empty() ||
+        (data.size() == entry.savedSize && dataHash == entry.savedHash)) {
+      continue;
+    }
+
+    BlobHeader header{.magic = blobMagic,
+                      .version = blobVersion,
+                      .vendorID = properties.vendorID,
+                      .deviceID = properties.deviceID,
+                      .driverVersion = properties.driverVersion,
+                      .pipelineKey = pipelineKey,
+                      .dataSize = data.size(),
+                      .dataHash = dataHash};
+    std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(),
+                VK_UUID_SIZE);
+
+    // Write next to the final file and rename, so a crash mid-write never
+    // leaves a half written blob behind.
+    const auto target = path(pipelineKey);
+    const auto temp = target + ".tmp";
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    file.close();
+    if (!file) {
+      std::cerr << std::format("[pipeline cache] Write {} failed\n", temp);
+      std::filesystem::remove(temp, error);
+      continue;
+    }
+    std::filesystem::rename(temp, target, error);
+    if (error) {
+      std::cerr << std::format("[pipeline cache] Rename {} failed: {}\n", temp,
+                               error.message());
+      std::filesystem::remove(temp, error);
+      continue;
+    }
+    entry.savedSize = data.size();
+    entry.savedHash = dataHash;
+  }
+}
+
+void PipelineCache::destroy() {
+  std::lock_guard lock(mutex);
+  for (const auto &[pipelineKey, entry] : caches) {
+    device.destroyPipelineCache(entry.cache);
+  }
+  caches.clear();
+}
+
+std::string PipelineCache::path(uint64_t pipelineKey) const {
+  return (std::filesystem::path(directory) /
+          std::format("{:016x}-{:016x}.bin", deviceKey, pipelineKey))
+      .string();
+}
+
+std::vector<char> PipelineCache::load(uint64_t pipelineKey) const {
+  if (directory.empty()) {
+    return {};
+  }
+  std::ifstream file(path(pipelineKey), std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    return {};
+  }
+  std::vector<char> blob(static_cast<std::size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(blob.data(), blob.size());
+  if (!file || !validate(blob, pipelineKey)) {
+    std::cerr << std::format("[pipeline cache] Ignoring stale blob {}\n",
+                             path(pipelineKey));
+    return {};
+  }
+  return blob;
+}
+
+bool PipelineCache::validate(const std::vector<char> &blob,
+                             uint64_t pipelineKey) const {
+  if (blob.size() < sizeof(BlobHeader)) {
+    return false;
+  }
+  BlobHeader header;
+  std::memcpy(&header, blob.data(), sizeof(header));
+
+  const char *data = blob.data() + sizeof(BlobHeader);
+  const std::size_t dataSize = blob.size() - sizeof(BlobHeader);
+  if (header.magic != blobMagic || header.version != blobVersion ||
+      header.vendorID != properties.vendorID ||
+      header.deviceID != properties.deviceID ||
+      header.driverVersion != properties.driverVersion ||
+      std::memcmp(header.pipelineCacheUUID,
+                  properties.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0 ||
+      header.pipelineKey != pipelineKey || header.dataSize != dataSize ||
+      header.dataHash != hashBytes(data, dataSize)) {
+    return false;
+  }
+
+  // Drivers are supposed to reject foreign data themselves, but not all of
+  // them do, so check the header they put in front of the blob as well.
+  VkPipelineCacheHeaderVersionOne driverHeader;
+  if (dataSize < sizeof(driverHeader)) {
+    return false;
+  }
+  std::memcpy(&driverHeader, data, sizeof(driverHeader));
+  return driverHeader.headerSize >= sizeof(driverHeader) &&
+         driverHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         driverHeader.vendorID == properties.vendorID &&
+         driverHeader.deviceID == properties.deviceID &&
+         std::memcmp(driverHeader.pipelineCacheUUID,
+                     properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
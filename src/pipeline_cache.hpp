@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vulkan/vulkan.hpp>
+
+// Driver pipeline caches persisted between runs. Every pipeline key gets its
+// own blob on disk, named after the device/driver and the key, and a blob is
+// only handed to the driver after checking it was written by the same device
+// and driver and is not truncated or corrupt. get() may be called from
+// several threads.
+class PipelineCache {
+public:
+  PipelineCache(vk::PhysicalDevice gpu, vk::Device device,
+                std::string directory);
+
+  // Returns the cache for a pipeline, loading it from disk on first use.
+  vk::PipelineCache get(uint64_t pipelineKey);
+  // Writes the caches whose data differs from what is on disk.
+  void save();
+  void destroy();
+
+private:
+  std::string path(uint64_t pipelineKey) const;
+  std::vector<char> load(uint64_t pipelineKey) const;
+  bool validate(const std::vector<char> &blob, uint64_t pipelineKey) const;
+
+  vk::Device device;
+  vk::PhysicalDeviceProperties properties;
+  uint64_t deviceKey = 0;
+  std::string directory;
+  std::mutex mutex;
+  struct Entry {
+    vk::PipelineCache cache;
+    // Size and hash of the data last loaded or saved, zero if none.
+    uint64_t savedSize = 0;
+    uint64_t savedHash = 0;
+  };
+  std::unordered_map<uint64_t, Entry> caches;
+};
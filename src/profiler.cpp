@@ -0,0 +1,312 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Past this the trace stops growing; percentiles keep updating.
+const std::size_t maxEvents = 1 << 21;
+
+double percentile(std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  auto index = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+std::string escapeJson(const std::string &text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+} // namespace
+
+void Profiler::init(vk::PhysicalDevice gpu, vk::Device device, vk::Queue queue,
+                    uint32_t queueFamily, uint32_t frameSlots,
+                    std::mutex *queueMutex) {
+  active = true;
+  this->device = device;
+  slots.resize(frameSlots);
+  for (auto &slot : slots) {
+    slot.scopes.reserve(maxQueriesPerSlot / 2);
+    slot.open.reserve(maxQueriesPerSlot / 2);
+  }
+  events.reserve(1 << 16);
+
+  auto properties = gpu.getProperties();
+  auto validBits =
+      gpu.getQueueFamilyProperties()[queueFamily].timestampValidBits;
+  gpuTiming = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+  if (!gpuTiming) {
+    std::cerr << "[profiler] Queue has no timestamp support, GPU timings "
+                 "disabled\n";
+    return;
+  }
+  timestampPeriodNs = properties.limits.timestampPeriod;
+  timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+  results.resize(maxQueriesPerSlot);
+
+  queryPool = device.createQueryPool(
+      vk::QueryPoolCreateInfo()
+          .setQueryType(vk::QueryType::eTimestamp)
+          .setQueryCount(frameSlots * maxQueriesPerSlot));
+
+  // Pair one GPU timestamp with the CPU clock. The submit latency ends up as
+  // a small constant offset on the GPU track.
+  auto commandPool = device.createCommandPool(
+      vk::CommandPoolCreateInfo()
+          .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+          .setQueueFamilyIndex(queueFamily));
+  auto allocInfo = vk::CommandBufferAllocateInfo()
+                       .setCommandPool(commandPool)
+                       .setLevel(vk::CommandBufferLevel::ePrimary)
+                       .setCommandBufferCount(1);
+  auto commandBuffer = device.allocateCommandBuffers(allocInfo).front();
+  commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+  commandBuffer.resetQueryPool(queryPool, 0, 1);
+  commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                               queryPool, 0);
+  commandBuffer.end();
+  // A fence rather than waiting for the queue to idle, which may be busy
+  // with other work.
+  auto fence = device.createFence(vk::FenceCreateInfo());
+  {
+    std::unique_lock<std::mutex> lock;
+    if (queueMutex) {
+      lock = std::unique_lock(*queueMutex);
+    }
+    queue.submit(vk::SubmitInfo().setCommandBuffers(commandBuffer), fence);
+  }
+  auto waited = device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+  auto now = Clock::now();
+  device.destroyFence(fence);
+  if (waited != vk::Result::eSuccess) {
+    throw std::runtime_error("Wait for profiler calibration failed.");
+  }
+
+  uint64_t ticks = 0;
+  if (device.getQueryPoolResults(queryPool, 0, 1, sizeof(ticks), &ticks,
+                                 sizeof(ticks),
+                                 vk::QueryResultFlagBits::e64 |
+                                     vk::QueryResultFlagBits::eWait) ==
+      vk::Result::eSuccess) {
+    calibrationTicks = ticks;
+    calibrationUs = sinceStartUs(now);
+  }
+  device.destroyCommandPool(commandPool);
+}
+
+void Profiler::destroy() {
+  if (queryPool) {
+    device.destroyQueryPool(queryPool);
+    queryPool = nullptr;
+  }
+}
+
+void Profiler::recordCpu(const char *name, Clock::time_point start,
+                         Clock::time_point end) {
+  if (!active) {
+    return;
+  }
+  addSample(scopeId(name, false), false, cpuFrame, sinceStartUs(start),
+            std::chrono::duration<double, std::micro>(end - start).count());
+}
+
+void Profiler::beginFrame(vk::CommandBuffer commandBuffer, uint32_t slot,
+                          uint64_t frame) {
+  if (!active) {
+    return;
+  }
+  cpuFrame = frame;
+  auto &s = slots[slot];
+  s.scopes.clear();
+  s.open.clear();
+  s.frame = frame;
+  if (gpuTiming) {
+    commandBuffer.resetQueryPool(queryPool, slot * maxQueriesPerSlot,
+                                 maxQueriesPerSlot);
+  }
+}
+
+void Profiler::beginGpuScope(vk::CommandBuffer commandBuffer, uint32_t slot,
+                             const std::string &name) {
+  if (!active) {
+    return;
+  }
+  auto &s = slots[slot];
+  if (!gpuTiming || (s.scopes.size() + 1) * 2 > maxQueriesPerSlot) {
+    s.open.push_back(UINT32_MAX);
+    return;
+  }
+  auto index = static_cast<uint32_t>(s.scopes.size());
+  s.scopes.push_back(scopeId(name, true));
+  s.open.push_back(index);
+  commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe,
+                               queryPool,
+                               slot * maxQueriesPerSlot + index * 2);
+}
+
+void Profiler::endGpuScope(vk::CommandBuffer commandBuffer, uint32_t slot) {
+  if (!active) {
+    return;
+  }
+  auto &s = slots[slot];
+  auto index = s.open.back();
+  s.open.pop_back();
+  if (index == UINT32_MAX) {
+    return;
+  }
+  commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                               queryPool,
+                               slot * maxQueriesPerSlot + index * 2 + 1);
+}
+
+std::optional<double> Profiler::collect(uint32_t slot) {
+  if (!gpuTiming) {
+    return std::nullopt;
+  }
+  auto &s = slots[slot];
+  if (s.scopes.empty()) {
+    return std::nullopt;
+  }
+  const auto count = static_cast<uint32_t>(s.scopes.size() * 2);
+  if (device.getQueryPoolResults(queryPool, slot * maxQueriesPerSlot, count,
+                                 count * sizeof(uint64_t), results.data(),
+                                 sizeof(uint64_t),
+                                 vk::QueryResultFlagBits::e64) !=
+      vk::Result::eSuccess) {
+    return std::nullopt;
+  }
+
+  const double usPerTick = timestampPeriodNs / 1000.0;
+  double frameMs = 0.0;
+  for (std::size_t i = 0; i < s.scopes.size(); i++) {
+    auto begin = results[i * 2], end = results[i * 2 + 1];
+    double startUs =
+        ((begin - calibrationTicks) & timestampMask) * usPerTick +
+        calibrationUs;
+    double durationUs = ((end - begin) & timestampMask) * usPerTick;
+    addSample(s.scopes[i], true, s.frame, startUs, durationUs);
+    // The outermost scope covers the whole frame.
+    if (i == 0) {
+      frameMs = durationUs / 1000.0;
+    }
+  }
+  s.scopes.clear();
+  return frameMs;
+}
+
+std::optional<Profiler::Percentiles>
+Profiler::percentiles(const std::string &name, bool gpu) const {
+  const auto &scopes = gpu ? gpuScopes : cpuScopes;
+  auto it = scopes.find(name);
+  if (it == scopes.end() || stats[it->second].window.empty()) {
+    return std::nullopt;
+  }
+  return windowPercentiles(it->second);
+}
+
+void Profiler::resetStats() {
+  for (auto &scope : stats) {
+    scope.window.clear();
+  }
+  events.clear();
+}
+
+void Profiler::report(std::ostream &out) const {
+  if (!active) {
+    return;
+  }
+  for (uint32_t scope = 0; scope < scopeNames.size(); scope++) {
+    auto result = windowPercentiles(scope);
+    out << std::format(
+        "[profiler] {} {:<16} p50 {:8.3f} ms  p95 {:8.3f} ms  p99 {:8.3f} ms\n",
+        scopeIsGpu[scope] ? "gpu" : "cpu", scopeNames[scope], result.p50,
+        result.p95, result.p99);
+  }
+}
+
+Profiler::Percentiles Profiler::windowPercentiles(uint32_t scope) const {
+  std::vector<double> sorted(stats[scope].window.begin(),
+                             stats[scope].window.end());
+  std::sort(sorted.begin(), sorted.end());
+  return Percentiles{.p50 = percentile(sorted, 0.50) / 1000.0,
+                     .p95 = percentile(sorted, 0.95) / 1000.0,
+                     .p99 = percentile(sorted, 0.99) / 1000.0,
+                     .samples = sorted.size()};
+}
+
+void Profiler::writeTrace(const std::string &path) const {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file.is_open()) {
+    std::cerr << std::format("[profiler] Open {} failed\n", path);
+    return;
+  }
+
+  if (std::filesystem::path(path).extension() == ".csv") {
+    file << "track,name,frame,start_us,duration_us\n";
+    for (const auto &event : events) {
+      file << std::format("{},{},{},{:.3f},{:.3f}\n",
+                          event.gpu ? "gpu" : "cpu", scopeNames[event.scope],
+                          event.frame, event.startUs, event.durationUs);
+    }
+    return;
+  }
+
+  // Chrome trace event format, loadable in chrome://tracing or Perfetto.
+  file << "{\"traceEvents\":[\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+          "\"args\":{\"name\":\"CPU\"}},\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+          "\"args\":{\"name\":\"GPU\"}}";
+  for (const auto &event : events) {
+    file << std::format(",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,"
+                        "\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},"
+                        "\"args\":{{\"frame\":{}}}}}",
+                        escapeJson(scopeNames[event.scope]),
+                        event.gpu ? 2 : 1, event.startUs, event.durationUs,
+                        event.frame);
+  }
+  file << "\n]}\n";
+}
+
+uint32_t Profiler::scopeId(const std::string &name, bool gpu) {
+  auto &scopes = gpu ? gpuScopes : cpuScopes;
+  if (auto it = scopes.find(name); it != scopes.end()) {
+    return it->second;
+  }
+  auto id = static_cast<uint32_t>(scopeNames.size());
+  scopeNames.push_back(name);
+  scopeIsGpu.push_back(gpu);
+  stats.emplace_back();
+  scopes.emplace(name, id);
+  return id;
+}
+
+void Profiler::addSample(uint32_t scope, bool gpu, uint64_t frame,
+                         double startUs, double durationUs) {
+  auto &window = stats[scope].window;
+  window.push_back(durationUs);
+  if (window.size() > windowSize) {
+    window.pop_front();
+  }
+  if (events.size() < maxEvents) {
+    events.push_back(Event{scope, gpu, frame, startUs, durationUs});
+  }
+}
+
+double Profiler::sinceStartUs(Clock::time_point time) const {
+  return std::chrono::duration<double, std::micro>(time - startTime).count();
+}
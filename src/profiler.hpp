@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// CPU frame-phase and GPU per-pass timings. GPU scopes are timestamp queries
+// kept per frame slot and read back once the slot's fence has been waited
+// on, so collecting them never stalls. Every scope keeps a rolling window for
+// p50/p95/p99, and the whole run can be exported as a Chrome trace (JSON) or
+// CSV. GPU times are placed on the CPU timeline with a one-off calibration,
+// which is good enough to see CPU/GPU overlap.
+class Profiler {
+public:
+  using Clock = std::chrono::steady_clock;
+  // Samples per scope that percentiles are taken over.
+  static constexpr std::size_t windowSize = 1024;
+
+  struct Percentiles {
+    double p50 = 0.0, p95 = 0.0, p99 = 0.0;
+    std::size_t samples = 0;
+  };
+
+  class CpuScope {
+  public:
+    CpuScope(Profiler &profiler, const char *name)
+        : profiler(profiler), name(name), start(Clock::now()) {}
+    ~CpuScope() { profiler.recordCpu(name, start, Clock::now()); }
+
+  private:
+    Profiler &profiler;
+    const char *name;
+    Clock::time_point start;
+  };
+
+  // `queueMutex`, if given, is held while submitting to `queue`.
+  void init(vk::PhysicalDevice gpu, vk::Device device, vk::Queue queue,
+            uint32_t queueFamily, uint32_t frameSlots,
+            std::mutex *queueMutex = nullptr);
+  void destroy();
+  bool enabled() const { return active; }
+
+  void recordCpu(const char *name, Clock::time_point start,
+                 Clock::time_point end);
+
+  // Called while recording a frame slot's command buffer.
+  void beginFrame(vk::CommandBuffer commandBuffer, uint32_t slot,
+                  uint64_t frame);
+  void beginGpuScope(vk::CommandBuffer commandBuffer, uint32_t slot,
+                     const std::string &name);
+  void endGpuScope(vk::CommandBuffer commandBuffer, uint32_t slot);
+  // Called after the slot's fence was waited on; reads its timestamps.
+  // Returns the GPU time of the slot's frame in milliseconds, or nullopt if
+  // the slot had no new timings.
+  std::optional<double> collect(uint32_t slot);
+
+  // Over the scope's rolling window, in milliseconds.
+  std::optional<Percentiles> percentiles(const std::string &name,
+                                         bool gpu) const;
+  // Drops every sample so far, e.g. those of warm-up frames.
+  void resetStats();
+
+  void report(std::ostream &out) const;
+  void writeTrace(const std::string &path) const;
+
+private:
+  struct Event {
+    uint32_t scope;
+    bool gpu;
+    uint64_t frame;
+    double startUs;
+    double durationUs;
+  };
+
+  struct Stats {
+    std::deque<double> window;
+  };
+
+  struct Slot {
+    std::vector<uint32_t> scopes;
+    std::vector<uint32_t> open;
+    uint64_t frame = 0;
+  };
+
+  uint32_t scopeId(const std::string &name, bool gpu);
+  Percentiles windowPercentiles(uint32_t scope) const;
+  void addSample(uint32_t scope, bool gpu, uint64_t frame, double startUs,
+                 double durationUs);
+  double sinceStartUs(Clock::time_point time) const;
+
+  static constexpr uint32_t maxQueriesPerSlot = 64;
+
+  bool active = false;
+  bool gpuTiming = false;
+  vk::Device device;
+  vk::QueryPool queryPool;
+  double timestampPeriodNs = 1.0;
+  uint64_t timestampMask = ~0ull;
+  uint64_t calibrationTicks = 0;
+  double calibrationUs = 0.0;
+  Clock::time_point startTime = Clock::now();
+  uint64_t cpuFrame = 0;
+
+  std::vector<Slot> slots;
+  std::vector<std::string> scopeNames;
+  std::vector<bool> scopeIsGpu;
+  std::unordered_map<std::string, uint32_t> cpuScopes, gpuScopes;
+  std::vector<Stats> stats;
+  std::vector<Event> events;
+  std::vector<uint64_t> results;
+};
@@ -0,0 +1,622 @@
+#include "render_graph.hpp"
+#include <algorithm>
+#include <array>
+#include <format>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+
+const auto colorRange =
+    vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+} // namespace
+
+RenderGraph::ImageId RenderGraph::addImage(std::string name,
+                                           vk::Format format) {
+  images.push_back(Image{.name = std::move(name), .format = format});
+  return static_cast<ImageId>(images.size() - 1);
+}
+
+RenderGraph::ImageId RenderGraph::addExternalImage(std::string name,
+                                                   vk::ImageView view,
+                                                   vk::Sampler sampler) {
+  images.push_back(Image{.name = std::move(name),
+                         .external = true,
+                         .externalView = view,
+                         .externalSampler = sampler});
+  return static_cast<ImageId>(images.size() - 1);
+}
+
+void RenderGraph::setExternalView(ImageId image, vk::ImageView view) {
+  images[image].externalView = view;
+  staleSlots.assign(frameSlots, true);
+}
+
+RenderGraph::PassId RenderGraph::addPass(std::string name,
+                                         std::vector<ImageId> reads,
+                                         std::optional<ImageId> target,
+                                         bool compute) {
+  if (compute && !target) {
+    throw std::runtime_error(
+        std::format("Compute pass {} needs a graph target.", name));
+  }
+  passes.push_back(Pass{.name = std::move(name),
+                        .reads = std::move(reads),
+                        .target = target,
+                        .compute = compute});
+  return static_cast<PassId>(passes.size() - 1);
+}
+
+void RenderGraph::compile(const Context &context, vk::Extent2D extent) {
+  device = context.device;
+  allocator = context.allocator;
+  this->extent = extent;
+  frameSlots = context.frameSlots;
+  staleSlots.assign(frameSlots, false);
+
+  // Resolve which reads see the previous frame and how long every image
+  // lives within a frame.
+  for (uint32_t p = 0; p < passes.size(); p++) {
+    auto &pass = passes[p];
+    if (pass.target) {
+      auto &image = images[*pass.target];
+      image.firstUse = std::min(image.firstUse, p);
+      image.lastUse = std::max(image.lastUse, p);
+      image.storage = pass.compute;
+    }
+
+    pass.readsHistory.assign(pass.reads.size(), false);
+    for (std::size_t i = 0; i < pass.reads.size(); i++) {
+      if (pass.reads[i] == noImage || images[pass.reads[i]].external) {
+        continue;
+      }
+      auto writer = std::find_if(passes.begin(), passes.end(),
+                                 [&](const Pass &other) {
+                                   return other.target == pass.reads[i];
+                                 });
+      if (writer == passes.end()) {
+        throw std::runtime_error(std::format(
+            "{} reads {}, which no pass writes.", pass.name,
+            images[pass.reads[i]].name));
+      }
+      auto &image = images[pass.reads[i]];
+      if (static_cast<uint32_t>(writer - passes.begin()) >= p) {
+        pass.readsHistory[i] = true;
+        image.history = true;
+      }
+      image.firstUse = std::min(image.firstUse, p);
+      image.lastUse = std::max(image.lastUse, p);
+    }
+  }
+
+  for (auto &image : images) {
+    if (image.external) {
+      continue;
+    }
+    const auto target = image.storage
+                            ? vk::ImageUsageFlagBits::eStorage
+                            : vk::ImageUsageFlagBits::eColorAttachment;
+    const auto usage = target | vk::ImageUsageFlagBits::eSampled |
+                       vk::ImageUsageFlagBits::eTransferSrc |
+                       vk::ImageUsageFlagBits::eTransferDst;
+    for (int i = 0; i < (image.history ? 2 : 1); i++) {
+      image.physical.push_back(
+          createPhysicalImage(image.format, usage, extent));
+    }
+  }
+  dummyImage = createPhysicalImage(vk::Format::eR8G8B8A8Unorm,
+                                   vk::ImageUsageFlagBits::eSampled |
+                                       vk::ImageUsageFlagBits::eTransferDst,
+                                   vk::Extent2D(1, 1));
+  allocateMemory(context);
+
+  for (auto &physical : physicalImages) {
+    auto viewInfo = vk::ImageViewCreateInfo()
+                        .setImage(physical.image)
+                        .setViewType(vk::ImageViewType::e2D)
+                        .setFormat(physical.format)
+                        .setSubresourceRange(colorRange);
+    physical.view = device.createImageView(viewInfo);
+  }
+  for (auto &image : images) {
+    if (image.storage || image.external) {
+      continue;
+    }
+    for (auto index : image.physical) {
+      auto &physical = physicalImages[index];
+      auto framebufferInfo = vk::FramebufferCreateInfo()
+                                 .setRenderPass(renderPassFor(image.format))
+                                 .setAttachments(physical.view)
+                                 .setWidth(extent.width)
+                                 .setHeight(extent.height)
+                                 .setLayers(1);
+      physical.framebuffer = device.createFramebuffer(framebufferInfo);
+    }
+  }
+
+  auto samplerInfo = vk::SamplerCreateInfo()
+                         .setMagFilter(vk::Filter::eLinear)
+                         .setMinFilter(vk::Filter::eLinear)
+                         .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+                         .setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+                         .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+                         .setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+                         .setMaxLod(VK_LOD_CLAMP_NONE);
+  sampler = device.createSampler(samplerInfo);
+
+  // Two sets per pass and frame slot, one per ping-pong parity, written once
+  // here so nothing has to be updated while recording. Per-slot sets let a
+  // new external view go into a slot's sets while other slots are in flight.
+  std::size_t bindingCount = 0, computeCount = 0;
+  for (const auto &pass : passes) {
+    bindingCount += pass.reads.size();
+    computeCount += pass.compute ? 1 : 0;
+  }
+  const auto graphicsSetCount = passes.size() * frameSlots * 2;
+  const auto setCount =
+      static_cast<uint32_t>(graphicsSetCount + computeCount * 2);
+  std::array<vk::DescriptorPoolSize, 2> poolSizes = {
+      vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler,
+                             static_cast<uint32_t>(std::max<std::size_t>(
+                                 bindingCount * frameSlots * 2, 1))),
+      vk::DescriptorPoolSize(
+          vk::DescriptorType::eStorageImage,
+          static_cast<uint32_t>(std::max<std::size_t>(computeCount * 2, 1)))};
+  descriptorPool = device.createDescriptorPool(
+      vk::DescriptorPoolCreateInfo().setMaxSets(setCount).setPoolSizes(
+          poolSizes));
+
+  std::vector<vk::DescriptorSetLayout> layouts(graphicsSetCount,
+                                               context.descriptorSetLayout);
+  layouts.resize(setCount, context.storageSetLayout);
+  auto sets = device.allocateDescriptorSets(
+      vk::DescriptorSetAllocateInfo()
+          .setDescriptorPool(descriptorPool)
+          .setSetLayouts(layouts));
+
+  std::vector<vk::DescriptorImageInfo> imageInfos;
+  imageInfos.reserve((bindingCount * frameSlots + computeCount) * 2);
+  std::vector<vk::WriteDescriptorSet> writes;
+  auto storageSet = sets.begin() + graphicsSetCount;
+  for (uint32_t p = 0; p < passes.size(); p++) {
+    auto &pass = passes[p];
+    const auto first = sets.begin() + p * frameSlots * 2;
+    pass.descriptorSets.assign(first, first + frameSlots * 2);
+    if (pass.compute) {
+      pass.storageSets = {storageSet[0], storageSet[1]};
+      storageSet += 2;
+      for (uint64_t parity = 0; parity < 2; parity++) {
+        imageInfos.push_back(vk::DescriptorImageInfo(
+            nullptr, physicalImages[physicalTarget(p, parity)].view,
+            vk::ImageLayout::eGeneral));
+        writes.push_back(
+            vk::WriteDescriptorSet()
+                .setDstSet(pass.storageSets[parity])
+                .setDstBinding(0)
+                .setDescriptorType(vk::DescriptorType::eStorageImage)
+                .setImageInfo(imageInfos.back()));
+      }
+    }
+    for (std::size_t set = 0; set < pass.descriptorSets.size(); set++) {
+      for (std::size_t i = 0; i < pass.reads.size(); i++) {
+        imageInfos.push_back(readInfo(p, i, set % 2));
+        writes.push_back(
+            vk::WriteDescriptorSet()
+                .setDstSet(pass.descriptorSets[set])
+                .setDstBinding(static_cast<uint32_t>(i))
+                .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+                .setImageInfo(imageInfos.back()));
+      }
+    }
+  }
+  device.updateDescriptorSets(writes, nullptr);
+}
+
+void RenderGraph::destroy() {
+  if (!device) {
+    return;
+  }
+  device.destroyDescriptorPool(descriptorPool);
+  device.destroySampler(sampler);
+  for (auto &physical : physicalImages) {
+    device.destroyFramebuffer(physical.framebuffer);
+    device.destroyImageView(physical.view);
+    device.destroyImage(physical.image);
+  }
+  for (auto &block : memoryBlocks) {
+    allocator->free(block.allocation);
+  }
+  for (auto &[format, pass] : renderPasses) {
+    device.destroyRenderPass(pass);
+  }
+  physicalImages.clear();
+  memoryBlocks.clear();
+  renderPasses.clear();
+  for (auto &image : images) {
+    image.physical.clear();
+    image.history = false;
+    image.firstUse = UINT32_MAX;
+    image.lastUse = 0;
+  }
+  initialized = false;
+}
+
+bool RenderGraph::hasFeedback() const {
+  return std::any_of(images.begin(), images.end(),
+                     [](const Image &image) { return image.history; });
+}
+
+void RenderGraph::setRenderArea(PassId pass, vk::Extent2D area) {
+  passes[pass].area = area;
+}
+
+vk::RenderPass RenderGraph::renderPass(PassId pass) const {
+  const auto &target = passes[pass].target;
+  if (!target || passes[pass].compute) {
+    return nullptr;
+  }
+  auto format = images[*target].format;
+  auto it = std::find_if(renderPasses.begin(), renderPasses.end(),
+                         [format](const auto &entry) {
+                           return entry.first == format;
+                         });
+  return it->second;
+}
+
+vk::DescriptorSet RenderGraph::descriptorSet(PassId pass, uint32_t slot,
+                                             uint64_t frame) const {
+  return passes[pass].descriptorSets[slot * 2 + frame % 2];
+}
+
+vk::DescriptorSet RenderGraph::storageSet(PassId pass, uint64_t frame) const {
+  return passes[pass].storageSets[frame % 2];
+}
+
+void RenderGraph::beginFrame(vk::CommandBuffer commandBuffer,
+                             uint32_t slot) {
+  if (staleSlots[slot]) {
+    writeExternalReads(slot);
+    staleSlots[slot] = false;
+  }
+  if (initialized) {
+    return;
+  }
+  // History images are read before they were ever written, and ShaderToy
+  // starts them out black; so does the dummy bound to unused channels.
+  std::vector<uint32_t> cleared{dummyImage};
+  for (const auto &image : images) {
+    if (image.history) {
+      cleared.insert(cleared.end(), image.physical.begin(),
+                     image.physical.end());
+    }
+  }
+
+  std::vector<vk::ImageMemoryBarrier> barriers;
+  for (auto index : cleared) {
+    barriers.push_back(
+        vk::ImageMemoryBarrier()
+            .setOldLayout(vk::ImageLayout::eUndefined)
+            .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setImage(physicalImages[index].image)
+            .setSubresourceRange(colorRange));
+  }
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                vk::PipelineStageFlagBits::eTransfer, {},
+                                nullptr, nullptr, barriers);
+
+  const vk::ClearColorValue black(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f});
+  for (auto index : cleared) {
+    auto &physical = physicalImages[index];
+    commandBuffer.clearColorImage(physical.image,
+                                  vk::ImageLayout::eTransferDstOptimal, black,
+                                  colorRange);
+    physical.state = {vk::ImageLayout::eTransferDstOptimal,
+                      vk::PipelineStageFlagBits::eTransfer,
+                      vk::AccessFlagBits::eTransferWrite};
+    auto &block = memoryBlocks[physical.memory];
+    block.stage = physical.state.stage;
+    block.access = physical.state.access;
+  }
+  initialized = true;
+}
+
+void RenderGraph::beginPass(vk::CommandBuffer commandBuffer, PassId p,
+                            uint64_t frame) {
+  const auto &pass = passes[p];
+  std::vector<vk::ImageMemoryBarrier> barriers;
+  vk::PipelineStageFlags srcStages, dstStages;
+
+  const auto transition = [&](PhysicalImage &physical, const Access &from,
+                              const Access &to) {
+    barriers.push_back(vk::ImageMemoryBarrier()
+                           .setOldLayout(from.layout)
+                           .setNewLayout(to.layout)
+                           .setSrcAccessMask(from.access)
+                           .setDstAccessMask(to.access)
+                           .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                           .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                           .setImage(physical.image)
+                           .setSubresourceRange(colorRange));
+    srcStages |= from.stage;
+    dstStages |= to.stage;
+    physical.state = to;
+    auto &block = memoryBlocks[physical.memory];
+    block.stage = to.stage;
+    block.access = to.access;
+  };
+
+  // Reads are made visible to both kinds of pass, so a later pass of the
+  // other kind can skip the barrier as well.
+  const Access sampled{vk::ImageLayout::eShaderReadOnlyOptimal,
+                       vk::PipelineStageFlagBits::eFragmentShader |
+                           vk::PipelineStageFlagBits::eComputeShader,
+                       vk::AccessFlagBits::eShaderRead};
+  for (std::size_t i = 0; i < pass.reads.size(); i++) {
+    if (pass.reads[i] != noImage && images[pass.reads[i]].external) {
+      continue;
+    }
+    auto &physical = physicalImages[physicalRead(p, i, frame)];
+    // Read after read needs no barrier.
+    if (physical.state.layout == sampled.layout &&
+        physical.state.access == sampled.access) {
+      continue;
+    }
+    transition(physical, physical.state, sampled);
+  }
+
+  if (!pass.target) {
+    if (!barriers.empty()) {
+      commandBuffer.pipelineBarrier(srcStages, dstStages, {}, nullptr, nullptr,
+                                    barriers);
+    }
+    return;
+  }
+
+  // The pass overwrites every texel, so the old contents are discarded. The
+  // source scope comes from the memory block, which also covers whatever
+  // other image aliased it last.
+  auto &target = physicalImages[physicalTarget(p, frame)];
+  const auto &block = memoryBlocks[target.memory];
+  const auto written =
+      pass.compute ? Access{vk::ImageLayout::eGeneral,
+                            vk::PipelineStageFlagBits::eComputeShader,
+                            vk::AccessFlagBits::eShaderWrite}
+                   : Access{vk::ImageLayout::eColorAttachmentOptimal,
+                            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                            vk::AccessFlagBits::eColorAttachmentWrite};
+  transition(target,
+             Access{vk::ImageLayout::eUndefined, block.stage, block.access},
+             written);
+  commandBuffer.pipelineBarrier(srcStages, dstStages, {}, nullptr, nullptr,
+                                barriers);
+  if (pass.compute) {
+    return;
+  }
+
+  auto renderPassInfo =
+      vk::RenderPassBeginInfo()
+          .setRenderPass(renderPass(p))
+          .setFramebuffer(target.framebuffer)
+          .setRenderArea(vk::Rect2D(vk::Offset2D(0, 0),
+                                    pass.area.width ? pass.area : extent));
+  commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+}
+
+void RenderGraph::endPass(vk::CommandBuffer commandBuffer, PassId pass) {
+  if (passes[pass].target && !passes[pass].compute) {
+    commandBuffer.endRenderPass();
+  }
+}
+
+vk::Image RenderGraph::transferSource(vk::CommandBuffer commandBuffer,
+                                      ImageId image, uint64_t frame) {
+  auto &physical = physicalImages[physicalImage(image, frame)];
+  const Access source{vk::ImageLayout::eTransferSrcOptimal,
+                      vk::PipelineStageFlagBits::eTransfer,
+                      vk::AccessFlagBits::eTransferRead};
+  auto barrier = vk::ImageMemoryBarrier()
+                     .setOldLayout(physical.state.layout)
+                     .setNewLayout(source.layout)
+                     .setSrcAccessMask(physical.state.access)
+                     .setDstAccessMask(source.access)
+                     .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                     .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                     .setImage(physical.image)
+                     .setSubresourceRange(colorRange);
+  commandBuffer.pipelineBarrier(physical.state.stage, source.stage, {},
+                                nullptr, nullptr, barrier);
+  physical.state = source;
+  auto &block = memoryBlocks[physical.memory];
+  block.stage = source.stage;
+  block.access = source.access;
+  return physical.image;
+}
+
+uint32_t RenderGraph::createPhysicalImage(vk::Format format,
+                                          vk::ImageUsageFlags usage,
+                                          vk::Extent2D size) {
+  auto imageInfo = vk::ImageCreateInfo()
+                       .setImageType(vk::ImageType::e2D)
+                       .setFormat(format)
+                       .setExtent(vk::Extent3D(size.width, size.height, 1))
+                       .setMipLevels(1)
+                       .setArrayLayers(1)
+                       .setSamples(vk::SampleCountFlagBits::e1)
+                       .setTiling(vk::ImageTiling::eOptimal)
+                       .setUsage(usage)
+                       .setSharingMode(vk::SharingMode::eExclusive)
+                       .setInitialLayout(vk::ImageLayout::eUndefined);
+  auto &physical = physicalImages.emplace_back();
+  physical.image = device.createImage(imageInfo);
+  physical.format = format;
+  return static_cast<uint32_t>(physicalImages.size() - 1);
+}
+
+void RenderGraph::allocateMemory(const Context &context) {
+  const auto newBlock = [this]() {
+    memoryBlocks.emplace_back();
+    return static_cast<uint32_t>(memoryBlocks.size() - 1);
+  };
+
+  // Greedy interval colouring: visit transient images by first use and put
+  // each into the first block whose previous occupant is already dead.
+  std::vector<uint32_t> order(images.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](auto a, auto b) {
+    return images[a].firstUse < images[b].firstUse;
+  });
+
+  std::vector<uint32_t> aliasable;
+  for (auto imageIndex : order) {
+    const auto &image = images[imageIndex];
+    for (auto index : image.physical) {
+      auto &physical = physicalImages[index];
+      auto requirements = device.getImageMemoryRequirements(physical.image);
+
+      uint32_t block = UINT32_MAX;
+      if (!image.history) {
+        for (auto candidate : aliasable) {
+          const auto &existing = memoryBlocks[candidate];
+          if (existing.lastUse < image.firstUse &&
+              (existing.typeBits & requirements.memoryTypeBits)) {
+            block = candidate;
+            break;
+          }
+        }
+        if (block == UINT32_MAX) {
+          block = newBlock();
+          aliasable.push_back(block);
+        }
+        memoryBlocks[block].lastUse = image.lastUse;
+      } else {
+        block = newBlock();
+      }
+
+      auto &memory = memoryBlocks[block];
+      memory.size = std::max(memory.size, requirements.size);
+      memory.alignment = std::max(memory.alignment, requirements.alignment);
+      memory.typeBits &= requirements.memoryTypeBits;
+      physical.memory = block;
+    }
+  }
+
+  auto &dummy = physicalImages[dummyImage];
+  dummy.memory = newBlock();
+  auto requirements = device.getImageMemoryRequirements(dummy.image);
+  memoryBlocks[dummy.memory].size = requirements.size;
+  memoryBlocks[dummy.memory].alignment = requirements.alignment;
+  memoryBlocks[dummy.memory].typeBits = requirements.memoryTypeBits;
+
+  for (auto &block : memoryBlocks) {
+    block.allocation = context.allocator->allocate(
+        vk::MemoryRequirements(block.size, block.alignment, block.typeBits),
+        vk::MemoryPropertyFlagBits::eDeviceLocal, {},
+        MemoryAllocator::Tiling::Optimal);
+  }
+  for (auto &physical : physicalImages) {
+    const auto &allocation = memoryBlocks[physical.memory].allocation;
+    device.bindImageMemory(physical.image, allocation.memory,
+                           allocation.offset);
+  }
+}
+
+vk::RenderPass RenderGraph::renderPassFor(vk::Format format) {
+  for (const auto &[existing, pass] : renderPasses) {
+    if (existing == format) {
+      return pass;
+    }
+  }
+
+  // Layouts are handled by the graph's own barriers, so the render pass
+  // neither transitions nor loads anything.
+  auto colorAttachment =
+      vk::AttachmentDescription{}
+          .setFormat(format)
+          .setSamples(vk::SampleCountFlagBits::e1)
+          .setLoadOp(vk::AttachmentLoadOp::eDontCare)
+          .setStoreOp(vk::AttachmentStoreOp::eStore)
+          .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+          .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+          .setInitialLayout(vk::ImageLayout::eColorAttachmentOptimal)
+          .setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
+  auto colorAttachmentRef =
+      vk::AttachmentReference{}.setAttachment(0).setLayout(
+          vk::ImageLayout::eColorAttachmentOptimal);
+  auto subpass = vk::SubpassDescription{}
+                     .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+                     .setColorAttachments(colorAttachmentRef);
+  auto renderPassInfo = vk::RenderPassCreateInfo()
+                            .setAttachments(colorAttachment)
+                            .setSubpasses(subpass);
+  auto pass = device.createRenderPass(renderPassInfo);
+  renderPasses.emplace_back(format, pass);
+  return pass;
+}
+
+uint32_t RenderGraph::physicalRead(PassId p, std::size_t binding,
+                                   uint64_t frame) const {
+  const auto &pass = passes[p];
+  if (pass.reads[binding] == noImage) {
+    return dummyImage;
+  }
+  const auto &image = images[pass.reads[binding]];
+  if (!image.history) {
+    return image.physical[0];
+  }
+  // The writer stores into physical[frame % 2]; history reads take the other.
+  return image.physical[(frame + (pass.readsHistory[binding] ? 1 : 0)) % 2];
+}
+
+vk::DescriptorImageInfo RenderGraph::readInfo(PassId p, std::size_t binding,
+                                              uint64_t frame) const {
+  const auto read = passes[p].reads[binding];
+  if (read != noImage && images[read].external) {
+    return vk::DescriptorImageInfo(images[read].externalSampler,
+                                   images[read].externalView,
+                                   vk::ImageLayout::eShaderReadOnlyOptimal);
+  }
+  return vk::DescriptorImageInfo(
+      sampler, physicalImages[physicalRead(p, binding, frame)].view,
+      vk::ImageLayout::eShaderReadOnlyOptimal);
+}
+
+void RenderGraph::writeExternalReads(uint32_t slot) {
+  std::size_t bindingCount = 0;
+  for (const auto &pass : passes) {
+    bindingCount += pass.reads.size();
+  }
+  std::vector<vk::DescriptorImageInfo> imageInfos;
+  imageInfos.reserve(bindingCount);
+  std::vector<vk::WriteDescriptorSet> writes;
+  for (uint32_t p = 0; p < passes.size(); p++) {
+    for (std::size_t i = 0; i < passes[p].reads.size(); i++) {
+      const auto read = passes[p].reads[i];
+      if (read == noImage || !images[read].external) {
+        continue;
+      }
+      imageInfos.push_back(readInfo(p, i, 0));
+      for (uint64_t parity = 0; parity < 2; parity++) {
+        writes.push_back(
+            vk::WriteDescriptorSet()
+                .setDstSet(passes[p].descriptorSets[slot * 2 + parity])
+                .setDstBinding(static_cast<uint32_t>(i))
+                .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+                .setImageInfo(imageInfos.back()));
+      }
+    }
+  }
+  device.updateDescriptorSets(writes, nullptr);
+}
+
+uint32_t RenderGraph::physicalTarget(PassId p, uint64_t frame) const {
+  return physicalImage(*passes[p].target, frame);
+}
+
+uint32_t RenderGraph::physicalImage(ImageId id, uint64_t frame) const {
+  const auto &image = images[id];
+  return image.history ? image.physical[frame % 2] : image.physical[0];
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "memory_allocator.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// A small render graph for ShaderToy style multi-pass rendering. Passes run
+// in the order they were added; each one samples any number of graph images
+// and writes one graph image, or (with no target) the caller's own render
+// target. Reading an image whose writer runs at or after the reader yields
+// the previous frame's contents, so such images get a ping-pong history pair.
+// Barriers and layout transitions are derived from the declared reads and
+// writes, and transient images whose lifetimes don't overlap share memory.
+// Compute passes write their target as a storage image instead of rendering
+// into it, and must have a graph target. External images (textures) are
+// owned elsewhere and only sampled; their view can be swapped at any time,
+// and each frame slot picks the new one up once its previous frame is done.
+class RenderGraph {
+public:
+  using ImageId = uint32_t;
+  using PassId = uint32_t;
+  static constexpr ImageId noImage = UINT32_MAX;
+
+  struct Context {
+    vk::Device device;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    // Set 1 of compute passes: the target as a storage image at binding 0.
+    vk::DescriptorSetLayout storageSetLayout;
+    MemoryAllocator *allocator;
+    uint32_t frameSlots = 1;
+  };
+
+  ImageId addImage(std::string name, vk::Format format);
+  // The view must stay in ShaderReadOnlyOptimal while passes may read it.
+  ImageId addExternalImage(std::string name, vk::ImageView view,
+                           vk::Sampler sampler);
+  void setExternalView(ImageId image, vk::ImageView view);
+  // reads[i] is bound to combined image sampler binding i (noImage binds a
+  // black dummy image). A missing target means the caller renders into its
+  // own attachment and only wants the barriers for the reads.
+  PassId addPass(std::string name, std::vector<ImageId> reads,
+                 std::optional<ImageId> target, bool compute = false);
+
+  void compile(const Context &context, vk::Extent2D extent);
+  void destroy();
+
+  // Restricts a graphics pass to the top-left `area` of its target, which
+  // keeps its full size, so this can change every frame without
+  // reallocating. The caller sets a matching viewport and scissor.
+  void setRenderArea(PassId pass, vk::Extent2D area);
+
+  vk::RenderPass renderPass(PassId pass) const;
+  vk::DescriptorSet descriptorSet(PassId pass, uint32_t slot,
+                                  uint64_t frame) const;
+  vk::DescriptorSet storageSet(PassId pass, uint64_t frame) const;
+  std::size_t passCount() const { return passes.size(); }
+  // Whether a pass reads an image's previous contents, so frames keep
+  // changing with unchanged inputs. Valid once compiled.
+  bool hasFeedback() const;
+
+  // Must be recorded once per frame before the first pass, once the slot's
+  // previous frame has finished.
+  void beginFrame(vk::CommandBuffer commandBuffer, uint32_t slot);
+  // Records the barriers the pass needs and, for passes with a graph target,
+  // begins its render pass.
+  void beginPass(vk::CommandBuffer commandBuffer, PassId pass, uint64_t frame);
+  void endPass(vk::CommandBuffer commandBuffer, PassId pass);
+  // Moves this frame's copy of an image into TransferSrcOptimal, for copies
+  // or blits recorded after the last pass.
+  vk::Image transferSource(vk::CommandBuffer commandBuffer, ImageId image,
+                           uint64_t frame);
+
+private:
+  struct Image {
+    std::string name;
+    vk::Format format;
+    bool history = false;
+    // Written by a compute pass.
+    bool storage = false;
+    bool external = false;
+    vk::ImageView externalView;
+    vk::Sampler externalSampler;
+    // First and last pass touching the image, for transient aliasing.
+    uint32_t firstUse = UINT32_MAX;
+    uint32_t lastUse = 0;
+    std::vector<uint32_t> physical;
+  };
+
+  struct Pass {
+    std::string name;
+    std::vector<ImageId> reads;
+    std::optional<ImageId> target;
+    bool compute = false;
+    // Zero means the whole target.
+    vk::Extent2D area;
+    // Whether reads[i] sees the previous frame's contents.
+    std::vector<bool> readsHistory;
+    // Indexed by slot * 2 + frame parity.
+    std::vector<vk::DescriptorSet> descriptorSets;
+    std::vector<vk::DescriptorSet> storageSets;
+  };
+
+  struct Access {
+    vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eTopOfPipe;
+    vk::AccessFlags access;
+  };
+
+  struct PhysicalImage {
+    vk::Image image;
+    vk::ImageView view;
+    vk::Framebuffer framebuffer;
+    vk::Format format;
+    // Index into memoryBlocks, shared with other images when aliased.
+    uint32_t memory;
+    Access state;
+  };
+
+  struct MemoryBlock {
+    Allocation allocation;
+    vk::DeviceSize size = 0;
+    vk::DeviceSize alignment = 1;
+    uint32_t typeBits = ~0u;
+    uint32_t lastUse = 0;
+    // Last access to the memory through any of the images aliasing it.
+    vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eTopOfPipe;
+    vk::AccessFlags access;
+  };
+
+  uint32_t createPhysicalImage(vk::Format format, vk::ImageUsageFlags usage,
+                               vk::Extent2D size);
+  void allocateMemory(const Context &context);
+  vk::RenderPass renderPassFor(vk::Format format);
+  uint32_t physicalRead(PassId pass, std::size_t binding, uint64_t frame) const;
+  vk::DescriptorImageInfo readInfo(PassId pass, std::size_t binding,
+                                   uint64_t frame) const;
+  void writeExternalReads(uint32_t slot);
+  uint32_t physicalTarget(PassId pass, uint64_t frame) const;
+  uint32_t physicalImage(ImageId image, uint64_t frame) const;
+
+  vk::Device device;
+  MemoryAllocator *allocator = nullptr;
+  vk::Extent2D extent;
+  std::vector<Image> images;
+  std::vector<Pass> passes;
+  std::vector<PhysicalImage> physicalImages;
+  std::vector<MemoryBlock> memoryBlocks;
+  std::vector<std::pair<vk::Format, vk::RenderPass>> renderPasses;
+  uint32_t dummyImage = 0;
+  vk::Sampler sampler;
+  vk::DescriptorPool descriptorPool;
+  bool initialized = false;
+  uint32_t frameSlots = 1;
+  // Slots whose sets still point at a replaced external view.
+  std::vector<bool> staleSlots;
+};
@@ -0,0 +1,67 @@
+#include "resolution_scaler.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Over this fraction of the budget the scale drops, under the lower one it
+// may grow. Growing aims between the two.
+const double upperBand = 1.05;
+const double lowerBand = 0.8;
+const double growTarget = 0.9;
+// Frames under budget before growing, and the largest single growth step.
+const uint32_t growDelay = 30;
+const float maxGrowth = 1.1f;
+const double smoothing = 0.25;
+const float scaleSteps = 32.0f;
+
+} // namespace
+
+ResolutionScaler::ResolutionScaler(double targetMs, float minScale,
+                                   uint32_t latency)
+    : targetMs(targetMs), minScale(minScale), latency(latency) {}
+
+bool ResolutionScaler::update(double gpuMs) {
+  if (gpuMs <= 0.0) {
+    return false;
+  }
+  if (settling > 0) {
+    settling--;
+    return false;
+  }
+  smoothedMs = smoothedMs == 0.0
+                   ? gpuMs
+                   : smoothedMs + (gpuMs - smoothedMs) * smoothing;
+
+  float wanted = current;
+  if (smoothedMs > targetMs * upperBand) {
+    underBudget = 0;
+    wanted = current * static_cast<float>(std::sqrt(targetMs / smoothedMs));
+  } else if (smoothedMs < targetMs * lowerBand) {
+    if (++underBudget >= growDelay) {
+      wanted = current * std::min(static_cast<float>(std::sqrt(
+                                      targetMs * growTarget / smoothedMs)),
+                                  maxGrowth);
+    }
+  } else {
+    underBudget = 0;
+  }
+  wanted = std::clamp(std::floor(wanted * scaleSteps) / scaleSteps, minScale,
+                      1.0f);
+  if (wanted == current) {
+    return false;
+  }
+
+  current = wanted;
+  smoothedMs = 0.0;
+  underBudget = 0;
+  settling = latency;
+  return true;
+}
+
+vk::Extent2D ResolutionScaler::extent(vk::Extent2D full) const {
+  const auto scaled = [this](uint32_t size) {
+    return std::max(static_cast<uint32_t>(std::lround(size * current)), 1u);
+  };
+  return vk::Extent2D(scaled(full.width), scaled(full.height));
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.hpp>
+
+// Picks a render scale from measured GPU frame times so that frames stay
+// within a budget. The cost of a full-screen shader grows with its pixel
+// count, so the scale moves by the square root of the over- or under-shoot.
+// It drops as soon as the smoothed time goes over budget but only grows after
+// a sustained stretch well under it, and steps are quantized, so the scale
+// settles instead of oscillating. Timings of frames recorded before a change
+// are ignored.
+class ResolutionScaler {
+public:
+  // `latency` is the number of frames between recording a frame and reading
+  // back its timings.
+  ResolutionScaler(double targetMs, float minScale, uint32_t latency);
+
+  // Feeds one GPU frame time; returns whether the scale changed.
+  bool update(double gpuMs);
+  float scale() const { return current; }
+  // `full` at the current scale, at least one pixel on each side.
+  vk::Extent2D extent(vk::Extent2D full) const;
+
+private:
+  double targetMs;
+  float minScale;
+  uint32_t latency;
+  float current = 1.0f;
+  double smoothedMs = 0.0;
+  uint32_t settling = 0;
+  uint32_t underBudget = 0;
+};
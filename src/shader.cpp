@@ -1,25 +1,261 @@
 #include "shader.hpp"
-#include <fstream>
-#include <iostream>
+#include "hash.hpp"
+#include <map>
+#include <stdexcept>
 #include <string>
-#include <vector>
 
-vk::ShaderModule createShaderModule(const std::string &path,
-                                    vk::Device device) {
-  std::ifstream loadFile(path, std::ios::ate | std::ios::binary);
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const uint32_t spirvMagic = 0x07230203;
+const std::size_t spirvHeaderWords = 5;
+
+} // namespace
+
+#ifdef _WIN32
+SpirvFile::SpirvFile(const std::string &path) {
+  fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (fileHandle == INVALID_HANDLE_VALUE) {
+    fileHandle = nullptr;
+    throw std::runtime_error("Open shader file failed.");
+  }
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(fileHandle, &fileSize);
+  if (fileSize.QuadPart == 0 || fileSize.QuadPart % sizeof(uint32_t) != 0) {
+    CloseHandle(fileHandle);
+    throw std::runtime_error("Invalid SPIR-V file size.");
+  }
+  mappingHandle =
+      CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  auto view = mappingHandle
+                  ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0)
+                  : nullptr;
+  if (view == nullptr) {
+    if (mappingHandle) {
+      CloseHandle(mappingHandle);
+    }
+    CloseHandle(fileHandle);
+    throw std::runtime_error("Map shader file failed.");
+  }
+  words = static_cast<const uint32_t *>(view);
+  wordCount = static_cast<std::size_t>(fileSize.QuadPart) / sizeof(uint32_t);
+}
 
-  if (!loadFile.is_open()) {
+SpirvFile::~SpirvFile() {
+  UnmapViewOfFile(words);
+  CloseHandle(mappingHandle);
+  CloseHandle(fileHandle);
+}
+#else
+SpirvFile::SpirvFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
     throw std::runtime_error("Open shader file failed.");
   }
-  auto fileSize = loadFile.tellg();
-  std::vector<char> buffer(fileSize);
-  loadFile.seekg(0);
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0 ||
+      info.st_size % sizeof(uint32_t) != 0) {
+    close(fd);
+    throw std::runtime_error("Invalid SPIR-V file size.");
+  }
+  void *view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    throw std::runtime_error("Map shader file failed.");
+  }
+  words = static_cast<const uint32_t *>(view);
+  wordCount = static_cast<std::size_t>(info.st_size) / sizeof(uint32_t);
+}
+
+SpirvFile::~SpirvFile() {
+  munmap(const_cast<uint32_t *>(words), wordCount * sizeof(uint32_t));
+}
+#endif
+
+void validateSpirv(std::span<const uint32_t> code) {
+  if (code.size() < spirvHeaderWords) {
+    throw std::runtime_error("SPIR-V module is too small.");
+  }
+  if (code[0] != spirvMagic) {
+    throw std::runtime_error("Not a SPIR-V module (bad magic number).");
+  }
+}
+
+uint64_t hashSpirv(std::span<const uint32_t> code) {
+  return hashBytes(code.data(), code.size_bytes());
+}
 
-  loadFile.close();
+void forEachSpirvInstruction(
+    std::span<const uint32_t> code,
+    const std::function<void(uint32_t, std::span<const uint32_t>)> &visit) {
+  validateSpirv(code);
+  for (std::size_t i = spirvHeaderWords; i < code.size();) {
+    const uint32_t wordCount = code[i] >> 16;
+    if (wordCount == 0 || i + wordCount > code.size()) {
+      throw std::runtime_error("Malformed SPIR-V instruction stream.");
+    }
+    visit(code[i] & 0xffff, code.subspan(i + 1, wordCount - 1));
+    i += wordCount;
+  }
+}
+
+std::string spirvString(std::span<const uint32_t> words) {
+  std::string text;
+  for (uint32_t word : words) {
+    for (int byte = 0; byte < 4; byte++) {
+      const char c = static_cast<char>((word >> (byte * 8)) & 0xff);
+      if (c == '\0') {
+        return text;
+      }
+      text += c;
+    }
+  }
+  return text;
+}
+
+std::optional<std::set<std::string>>
+spirvBlockMembersRead(std::span<const uint32_t> code) {
+  const uint32_t opEntryPoint = 15, opName = 5, opMemberName = 6;
+  const uint32_t opTypeStruct = 30, opTypePointer = 32, opConstant = 43;
+  const uint32_t opVariable = 59, opAccessChain = 65;
+  const uint32_t opInBoundsAccessChain = 66, opDecorate = 71;
+  const uint32_t opMemberDecorate = 72;
+  const uint32_t storageUniform = 2, storagePushConstant = 9;
+
+  std::map<std::pair<uint32_t, uint32_t>, std::string> memberNames;
+  std::map<uint32_t, uint32_t> memberCounts;
+  std::map<uint32_t, uint32_t> pointees;
+  std::map<uint32_t, uint32_t> constants;
+  // Block variable -> struct type.
+  std::map<uint32_t, uint32_t> blocks;
+  std::set<std::pair<uint32_t, uint32_t>> read;
+  bool unnamed = false;
+
+  const auto readMember = [&](uint32_t type, uint32_t member) {
+    if (!memberNames.contains({type, member})) {
+      unnamed = true;
+    }
+    read.insert({type, member});
+  };
+  const auto readBlock = [&](uint32_t type) {
+    for (uint32_t member = 0; member < memberCounts[type]; member++) {
+      readMember(type, member);
+    }
+  };
+
+  forEachSpirvInstruction(code, [&](uint32_t opcode,
+                                    std::span<const uint32_t> operands) {
+    switch (opcode) {
+    case opMemberName:
+      if (operands.size() >= 3) {
+        memberNames[{operands[0], operands[1]}] =
+            spirvString(operands.subspan(2));
+      }
+      return;
+    case opTypeStruct:
+      memberCounts[operands[0]] = static_cast<uint32_t>(operands.size() - 1);
+      return;
+    case opTypePointer:
+      pointees[operands[0]] = operands[2];
+      return;
+    case opConstant:
+      constants[operands[1]] = operands[2];
+      return;
+    case opVariable:
+      if ((operands[2] == storageUniform ||
+           operands[2] == storagePushConstant) &&
+          memberCounts.contains(pointees[operands[0]])) {
+        blocks[operands[1]] = pointees[operands[0]];
+      }
+      return;
+    case opEntryPoint:
+    case opName:
+    case opDecorate:
+    case opMemberDecorate:
+      return;
+    case opAccessChain:
+    case opInBoundsAccessChain:
+      if (operands.size() >= 4 && blocks.contains(operands[2])) {
+        const auto type = blocks[operands[2]];
+        if (auto index = constants.find(operands[3]);
+            index != constants.end()) {
+          readMember(type, index->second);
+        } else {
+          readBlock(type);
+        }
+        return;
+      }
+      break;
+    }
+    // Any other use of a block, e.g. loading it whole.
+    for (auto operand : operands) {
+      if (auto block = blocks.find(operand); block != blocks.end()) {
+        readBlock(block->second);
+      }
+    }
+  });
+
+  if (unnamed) {
+    return std::nullopt;
+  }
+  std::set<std::string> names;
+  for (const auto &member : read) {
+    names.insert(memberNames[member]);
+  }
+  return names;
+}
+
+vk::ShaderModule ShaderModuleCache::acquire(uint64_t hash,
+                                            std::span<const uint32_t> code) {
+  std::lock_guard lock(mutex);
+  if (auto it = modules.find(hash); it != modules.end()) {
+    if (it->second.wordCount != code.size()) {
+      throw std::runtime_error("Shader module hash collision.");
+    }
+    it->second.users++;
+    return it->second.module;
+  }
+
+  auto module = createShaderModule(code, device);
+  modules.emplace(hash, Entry{module, code.size(), 1});
+  return module;
+}
+
+void ShaderModuleCache::release(uint64_t hash) {
+  std::lock_guard lock(mutex);
+  auto it = modules.find(hash);
+  if (it != modules.end() && --it->second.users == 0) {
+    device.destroyShaderModule(it->second.module);
+    modules.erase(it);
+  }
+}
+
+void ShaderModuleCache::destroy() {
+  std::lock_guard lock(mutex);
+  for (const auto &[hash, entry] : modules) {
+    device.destroyShaderModule(entry.module);
+  }
+  modules.clear();
+}
+
+vk::ShaderModule createShaderModule(std::span<const uint32_t> code,
+                                    vk::Device device) {
+  validateSpirv(code);
 
   vk::ShaderModuleCreateInfo createInfo = {};
-  createInfo.setCodeSize(buffer.size());
-  createInfo.setPCode(reinterpret_cast<const uint32_t *>(buffer.data()));
+  createInfo.setCodeSize(code.size_bytes());
+  createInfo.setPCode(code.data());
 
   vk::ShaderModule shaderModule;
   if (device.createShaderModule(&createInfo, 0, &shaderModule) !=
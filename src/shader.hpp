@@ -1,3 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <unordered_map>
 #include <vulkan/vulkan.hpp>
 
-vk::ShaderModule createShaderModule(const std::string &path, vk::Device device);
\ No newline at end of file
+// Read-only memory mapping of a .spv file. Mappings are page aligned, so the
+// words can be handed to Vulkan without copying.
+class SpirvFile {
+public:
+  explicit SpirvFile(const std::string &path);
+  ~SpirvFile();
+
+  SpirvFile(const SpirvFile &) = delete;
+  SpirvFile &operator=(const SpirvFile &) = delete;
+
+  std::span<const uint32_t> code() const { return {words, wordCount}; }
+
+private:
+  const uint32_t *words = nullptr;
+  std::size_t wordCount = 0;
+#ifdef _WIN32
+  void *fileHandle = nullptr;
+  void *mappingHandle = nullptr;
+#endif
+};
+
+// Checks the SPIR-V header; throws if the words can't be a SPIR-V module.
+void validateSpirv(std::span<const uint32_t> code);
+uint64_t hashSpirv(std::span<const uint32_t> code);
+// Calls `visit` with the opcode and operand words of every instruction after
+// the header; throws on a malformed instruction stream.
+void forEachSpirvInstruction(
+    std::span<const uint32_t> code,
+    const std::function<void(uint32_t, std::span<const uint32_t>)> &visit);
+// A nul-terminated literal string starting at the first operand word.
+std::string spirvString(std::span<const uint32_t> words);
+// Names of the uniform and push constant block members the module reads. A
+// block used other than through access chains counts as read in full;
+// nullopt if a read member has no name (stripped SPIR-V).
+std::optional<std::set<std::string>>
+spirvBlockMembersRead(std::span<const uint32_t> code);
+
+// Shader modules keyed by content hash, so a shader used by several pipelines
+// is only created once. Each acquire() is matched by a release(), and a
+// module is destroyed with its last user, so apps sharing a device don't pile
+// up the modules of finished jobs. Thread safe.
+class ShaderModuleCache {
+public:
+  explicit ShaderModuleCache(vk::Device device) : device(device) {}
+
+  vk::ShaderModule acquire(uint64_t hash, std::span<const uint32_t> code);
+  void release(uint64_t hash);
+  // Destroys every module, released or not.
+  void destroy();
+
+private:
+  struct Entry {
+    vk::ShaderModule module;
+    std::size_t wordCount;
+    uint32_t users;
+  };
+
+  vk::Device device;
+  std::mutex mutex;
+  std::unordered_map<uint64_t, Entry> modules;
+};
+
+vk::ShaderModule createShaderModule(std::span<const uint32_t> code,
+                                    vk::Device device);
\ No newline at end of file
@@ -0,0 +1,245 @@
+#include "shader_compiler.hpp"
+#include "hash.hpp"
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <shaderc/shaderc.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Bump when the wrappers below or the compile options change.
+const uint64_t cacheFormatVersion = 7;
+
+const char *fullscreenVertexSource = R"(#version 450
+void main() {
+  vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+  gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// Mirrors struct ShaderInputs.
+const char *shaderToyInputs = R"( uniform ShaderToyInputs {
+  vec3 iResolution;
+  float iTime;
+  vec4 iMouse;
+  vec4 iDate;
+  float iTimeDelta;
+  float iFrameRate;
+  int iFrame;
+  int iSample;
+  vec2 shaderToyFragOffset;
+};
+)";
+
+const char *shaderToyPrelude = R"(
+layout(location = 0) out vec4 shaderToyFragColor;
+)";
+
+// ShaderToy puts the fragCoord origin at the bottom left, Vulkan at the top.
+// Only the Image pass is flipped, so that what it shows is upright. Buffer
+// passes keep Vulkan's rows: a buffer sampled at fragCoord / iResolution
+// then returns the texel that fragCoord wrote, as textures do, which are
+// uploaded bottom row first.
+const char *shaderToyMain = R"(
+void main() {
+  vec4 color = vec4(0.0, 0.0, 0.0, 1.0);
+  vec2 pixel = gl_FragCoord.xy + shaderToyFragOffset;
+#ifdef SHADERTOY_FLIP_Y
+  pixel.y = iResolution.y - pixel.y;
+#endif
+  mainImage(color, pixel);
+  shaderToyFragColor = color;
+}
+)";
+
+// The compute variant writes each invocation's texel to a storage image,
+// skipping texels outside iResolution: the image is larger than that when
+// the Image pass is rendered at a reduced scale, and an edge tile of a tiled
+// still reaches past it. The workgroup size comes from specialization
+// constants 0 and 1. There are no derivatives in compute, so shaders relying
+// on dFdx()/fwidth() or on texture() picking a mip level belong on the
+// graphics path.
+const char *shaderToyComputePrelude = R"(
+layout(local_size_x_id = 0, local_size_y_id = 1) in;
+layout(set = 1, binding = 0, rgba16f) uniform writeonly image2D shaderToyOutput;
+)";
+
+const char *shaderToyComputeMain = R"(
+void main() {
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  vec2 pixel = vec2(texel) + 0.5 + shaderToyFragOffset;
+  if (any(greaterThanEqual(texel, imageSize(shaderToyOutput))) ||
+      any(greaterThan(pixel, iResolution.xy))) {
+    return;
+  }
+  vec4 color = vec4(0.0, 0.0, 0.0, 1.0);
+#ifdef SHADERTOY_FLIP_Y
+  pixel.y = iResolution.y - pixel.y;
+#endif
+  mainImage(color, pixel);
+  imageStore(shaderToyOutput, texel, color);
+}
+)";
+
+std::string channelDeclarations(const ChannelTypes &channels) {
+  std::string declarations;
+  for (std::size_t i = 0; i < channels.size(); i++) {
+    const char *type = channels[i] == vk::ImageViewType::eCube ? "samplerCube"
+                       : channels[i] == vk::ImageViewType::e3D ? "sampler3D"
+                                                               : "sampler2D";
+    declarations += std::format(
+        "layout(set = 0, binding = {}) uniform {} iChannel{};\n", i, type, i);
+  }
+  return declarations;
+}
+
+bool isShaderToySource(const std::string &source) {
+  return source.find("#version") == std::string::npos &&
+         source.find("mainImage") != std::string::npos;
+}
+
+shaderc_shader_kind shaderKind(vk::ShaderStageFlagBits stage) {
+  switch (stage) {
+  case vk::ShaderStageFlagBits::eVertex:
+    return shaderc_vertex_shader;
+  case vk::ShaderStageFlagBits::eFragment:
+    return shaderc_fragment_shader;
+  case vk::ShaderStageFlagBits::eCompute:
+    return shaderc_compute_shader;
+  default:
+    throw std::runtime_error("Unsupported shader stage.");
+  }
+}
+
+std::string readText(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error(std::format("Open shader file {} failed.", path));
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+
+} // namespace
+
+ShaderCode ShaderCompiler::load(const std::string &path,
+                                vk::ShaderStageFlagBits stage,
+                                const ChannelTypes &channels,
+                                bool imagePass) const {
+  ShaderCode shader;
+  if (path.empty()) {
+    shader.words = compile(fullscreenVertexSource, "fullscreen.vert", stage);
+  } else if (std::filesystem::path(path).extension() == ".spv") {
+    shader.file = std::make_unique<SpirvFile>(path);
+  } else {
+    shader.words =
+        compileSource(readText(path), path, stage, channels, imagePass);
+  }
+  return shader;
+}
+
+std::vector<uint32_t>
+ShaderCompiler::compileSource(std::string source, const std::string &name,
+                              vk::ShaderStageFlagBits stage,
+                              const ChannelTypes &channels,
+                              bool imagePass) const {
+  const bool fragment = stage == vk::ShaderStageFlagBits::eFragment;
+  const bool compute = stage == vk::ShaderStageFlagBits::eCompute;
+  if ((fragment || compute) && isShaderToySource(source)) {
+    // The inputs follow the sets the pipeline layouts already use.
+    auto inputs = inputRing ? std::format("layout(set = {}, binding = 0)",
+                                          fragment ? 1 : 2)
+                            : std::string("layout(push_constant)");
+    auto prelude = std::format(
+        "#version 450\n{}{}{}{}{}#line 1\n",
+        imagePass ? "#define SHADERTOY_FLIP_Y\n" : "", inputs,
+        shaderToyInputs, fragment ? shaderToyPrelude : shaderToyComputePrelude,
+        channelDeclarations(channels));
+    source = prelude + source +
+             (fragment ? shaderToyMain : shaderToyComputeMain);
+  }
+  return compile(source, name, stage);
+}
+
+std::vector<uint32_t>
+ShaderCompiler::compile(const std::string &source, const std::string &name,
+                        vk::ShaderStageFlagBits stage) const {
+  unsigned spvVersion = 0, spvRevision = 0;
+  shaderc_get_spv_version(&spvVersion, &spvRevision);
+
+  auto key = hashBytes(source.data(), source.size());
+  key = hashCombine(key, static_cast<uint64_t>(stage));
+  key = hashCombine(key, spvVersion);
+  key = hashCombine(key, spvRevision);
+  key = hashCombine(key, cacheFormatVersion);
+
+  if (!cacheDir.empty()) {
+    try {
+      // The words are followed by their hash, so a short or damaged entry
+      // is compiled again instead of reaching the driver.
+      SpirvFile cached(cachePath(key));
+      const auto words = cached.code();
+      const std::size_t hashWords = sizeof(uint64_t) / sizeof(uint32_t);
+      if (words.size() > hashWords) {
+        const auto code = words.first(words.size() - hashWords);
+        uint64_t hash;
+        std::memcpy(&hash, code.data() + code.size(), sizeof(hash));
+        if (hash == hashSpirv(code)) {
+          validateSpirv(code);
+          return {code.begin(), code.end()};
+        }
+      }
+    } catch (const std::exception &) {
+      // Missing or unreadable: fall through and compile.
+    }
+  }
+
+  shaderc::CompileOptions compileOptions;
+  compileOptions.SetSourceLanguage(shaderc_source_language_glsl);
+  compileOptions.SetTargetEnvironment(shaderc_target_env_vulkan,
+                                      shaderc_env_version_vulkan_1_3);
+  compileOptions.SetOptimizationLevel(shaderc_optimization_level_performance);
+
+  shaderc::Compiler compiler;
+  auto result = compiler.CompileGlslToSpv(source, shaderKind(stage),
+                                          name.c_str(), compileOptions);
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+    throw std::runtime_error(result.GetErrorMessage());
+  }
+  std::vector<uint32_t> spirv(result.cbegin(), result.cend());
+
+  if (!cacheDir.empty()) {
+    std::error_code error;
+    std::filesystem::create_directories(cacheDir, error);
+    const auto target = cachePath(key);
+    const auto temp = std::format("{}.{}.tmp", target,
+                                  std::hash<std::thread::id>{}(
+                                      std::this_thread::get_id()));
+    const uint64_t hash = hashSpirv(spirv);
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(spirv.data()),
+               spirv.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
+    file.close();
+    if (!file) {
+      std::cerr << std::format("[shader cache] Write {} failed\n", temp);
+      std::filesystem::remove(temp, error);
+    } else if (std::filesystem::rename(temp, target, error); error) {
+      std::cerr << std::format("[shader cache] Rename {} failed: {}\n", temp,
+                               error.message());
+      std::filesystem::remove(temp, error);
+    }
+  }
+  return spirv;
+}
+
+std::string ShaderCompiler::cachePath(uint64_t key) const {
+  return (std::filesystem::path(cacheDir) / std::format("{:016x}.spv", key))
+      .string();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "shader.hpp"
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+// View type of each iChannel, which decides its sampler type in the
+// ShaderToy wrappers.
+using ChannelTypes = std::array<vk::ImageViewType, 4>;
+inline constexpr ChannelTypes defaultChannelTypes = {
+    vk::ImageViewType::e2D, vk::ImageViewType::e2D, vk::ImageViewType::e2D,
+    vk::ImageViewType::e2D};
+
+// SPIR-V for one stage, either mapped straight from a .spv file or produced
+// by the compiler.
+struct ShaderCode {
+  std::unique_ptr<SpirvFile> file;
+  std::vector<uint32_t> words;
+
+  std::span<const uint32_t> code() const {
+    return file ? file->code() : std::span<const uint32_t>(words);
+  }
+};
+
+// Turns shader paths into SPIR-V. .spv files are mapped as they are; GLSL is
+// compiled in-process with shaderc at the performance optimization level
+// (which runs the spirv-opt performance recipe). ShaderToy sources, which
+// only define mainImage(), are wrapped in a fragment or compute shader first.
+// Compiled results are kept on disk keyed by the source and compiler options,
+// so an unchanged shader is never compiled twice. Safe to use from several
+// threads.
+class ShaderCompiler {
+public:
+  explicit ShaderCompiler(std::string cacheDir)
+      : cacheDir(std::move(cacheDir)) {}
+
+  // Declare the ShaderToy inputs as a uniform buffer instead of push
+  // constants. Must be set before the first load().
+  void setInputRing(bool ring) { inputRing = ring; }
+
+  // An empty path selects the built-in full-screen triangle vertex shader.
+  // `imagePass` gives a ShaderToy source ShaderToy's bottom-left fragCoord
+  // origin; other passes keep Vulkan's.
+  ShaderCode load(const std::string &path, vk::ShaderStageFlagBits stage,
+                  const ChannelTypes &channels = defaultChannelTypes,
+                  bool imagePass = false) const;
+  // GLSL source, wrapped like a file's.
+  std::vector<uint32_t>
+  compileSource(std::string source, const std::string &name,
+                vk::ShaderStageFlagBits stage,
+                const ChannelTypes &channels = defaultChannelTypes,
+                bool imagePass = false) const;
+  std::vector<uint32_t> compile(const std::string &source,
+                                const std::string &name,
+                                vk::ShaderStageFlagBits stage) const;
+
+private:
+  std::string cachePath(uint64_t key) const;
+
+  std::string cacheDir;
+  bool inputRing = false;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// ShaderToy's per-frame uniforms. The layout matches the ShaderToyInputs
+// block declared by the GLSL wrappers under both std140 and std430, so the
+// same bytes can go into push constants or a uniform buffer.
+struct ShaderInputs {
+  float iResolution[3];
+  float iTime;
+  // xy: position while a button is held; zw: last click, negative once the
+  // button is released (z) and after the click frame (w).
+  float iMouse[4];
+  // Year, month (0-11), day (1-31) and seconds since midnight.
+  float iDate[4];
+  float iTimeDelta;
+  float iFrameRate;
+  int32_t iFrame;
+  // Index of the sample being added in accumulation mode, counting from
+  // zero after every restart; zero otherwise.
+  int32_t iSample;
+  // Added to gl_FragCoord by the wrappers, so a tile of a larger image sees
+  // that image's coordinates. Vulkan's top-left origin.
+  float fragOffset[2];
+};
+
+static_assert(sizeof(ShaderInputs) == 72);
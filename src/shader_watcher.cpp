@@ -0,0 +1,109 @@
+#include "shader_watcher.hpp"
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std::chrono_literals;
+
+namespace {
+
+std::string normalize(const std::filesystem::path &path) {
+  return std::filesystem::absolute(path).lexically_normal().string();
+}
+
+} // namespace
+
+ShaderWatcher::ShaderWatcher(std::vector<std::string> paths,
+                             std::function<void()> onChange)
+    : paths(std::move(paths)), onChange(std::move(onChange)) {
+  thread = std::thread(&ShaderWatcher::run, this);
+}
+
+ShaderWatcher::~ShaderWatcher() {
+  stopping = true;
+  thread.join();
+}
+
+#ifdef __linux__
+void ShaderWatcher::run() {
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+
+  std::set<std::string> watched;
+  std::unordered_map<int, std::filesystem::path> directories;
+  for (const auto &path : paths) {
+    auto file = std::filesystem::path(normalize(path));
+    watched.insert(file.string());
+    int wd = inotify_add_watch(fd, file.parent_path().c_str(),
+                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd >= 0) {
+      directories[wd] = file.parent_path();
+    }
+  }
+
+  alignas(inotify_event) char buffer[4096];
+  const auto drain = [&]() {
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+      for (char *p = buffer; p < buffer + length;) {
+        auto event = reinterpret_cast<const inotify_event *>(p);
+        if (event->len > 0 && directories.contains(event->wd)) {
+          auto file = (directories[event->wd] / event->name).string();
+          changed = changed || watched.contains(file);
+        }
+        p += sizeof(inotify_event) + event->len;
+      }
+    }
+    return changed;
+  };
+
+  while (!stopping) {
+    pollfd pfd{.fd = fd, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, 100) <= 0 || !drain()) {
+      continue;
+    }
+    // Editors tend to write a file in several steps; let them settle so we
+    // only rebuild once.
+    std::this_thread::sleep_for(50ms);
+    drain();
+    onChange();
+  }
+  close(fd);
+}
+#else
+void ShaderWatcher::run() {
+  const auto lastWrite = [](const std::string &path) {
+    std::error_code error;
+    return std::filesystem::last_write_time(path, error);
+  };
+  std::vector<std::filesystem::file_time_type> times;
+  for (const auto &path : paths) {
+    times.push_back(lastWrite(path));
+  }
+
+  while (!stopping) {
+    std::this_thread::sleep_for(250ms);
+    bool changed = false;
+    for (std::size_t i = 0; i < paths.size(); i++) {
+      auto time = lastWrite(paths[i]);
+      if (time != times[i]) {
+        times[i] = time;
+        changed = true;
+      }
+    }
+    if (changed) {
+      onChange();
+    }
+  }
+}
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Watches shader files and calls onChange on its own thread whenever one of
+// them is written. Watching the parent directories (inotify on Linux, mtime
+// polling elsewhere) also catches editors that save by renaming a temp file.
+class ShaderWatcher {
+public:
+  ShaderWatcher(std::vector<std::string> paths, std::function<void()> onChange);
+  ~ShaderWatcher();
+
+  ShaderWatcher(const ShaderWatcher &) = delete;
+  ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+private:
+  void run();
+
+  std::vector<std::string> paths;
+  std::function<void()> onChange;
+  std::atomic<bool> stopping = false;
+  std::thread thread;
+};
@@ -0,0 +1,196 @@
+#include "spec_constants.hpp"
+#include "hash.hpp"
+#include "shader.hpp"
+#include <bit>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+// SPIR-V opcodes and decorations read here.
+const uint32_t opName = 5;
+const uint32_t opTypeBool = 20;
+const uint32_t opTypeInt = 21;
+const uint32_t opTypeFloat = 22;
+const uint32_t opSpecConstantTrue = 48;
+const uint32_t opSpecConstantFalse = 49;
+const uint32_t opSpecConstant = 50;
+const uint32_t opDecorate = 71;
+const uint32_t decorationSpecId = 1;
+
+enum class Kind { Bool, Int, Uint, Float };
+
+struct Type {
+  Kind kind;
+  uint32_t width = 32;
+};
+
+std::string trim(const std::string &text) {
+  const auto first = text.find_first_not_of(" \t\r");
+  if (first == std::string::npos) {
+    return {};
+  }
+  const auto last = text.find_last_not_of(" \t\r");
+  return text.substr(first, last - first + 1);
+}
+
+uint32_t convert(const std::string &name, const std::string &value,
+                 const Type &type) {
+  if (type.width != 32) {
+    throw std::runtime_error(std::format(
+        "Specialization constant {} is not 32 bits wide.", name));
+  }
+  try {
+    switch (type.kind) {
+    case Kind::Bool:
+      if (value == "true" || value == "1") {
+        return VK_TRUE;
+      }
+      if (value == "false" || value == "0") {
+        return VK_FALSE;
+      }
+      break;
+    case Kind::Int:
+      return static_cast<uint32_t>(std::stoi(value));
+    case Kind::Uint:
+      return static_cast<uint32_t>(std::stoul(value));
+    case Kind::Float:
+      return std::bit_cast<uint32_t>(std::stof(value));
+    }
+  } catch (const std::logic_error &) {
+  }
+  throw std::runtime_error(std::format(
+      "Bad value {} for specialization constant {}.", value, name));
+}
+
+} // namespace
+
+SpecValues loadSpecConfig(const std::string &path, const std::string &tier) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::runtime_error(std::format("Open {} failed.", path));
+  }
+  SpecValues defaults, tierValues;
+  SpecValues *section = &defaults;
+  bool tierFound = tier.empty();
+  std::string line;
+  for (uint32_t number = 1; std::getline(file, line); number++) {
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    if (line.front() == '[' && line.back() == ']') {
+      const bool selected = line.substr(1, line.size() - 2) == tier;
+      tierFound |= selected;
+      section = selected ? &tierValues : nullptr;
+      continue;
+    }
+    const auto equals = line.find('=');
+    if (equals == std::string::npos) {
+      throw std::runtime_error(
+          std::format("{} line {}: expected NAME=value.", path, number));
+    }
+    if (section) {
+      (*section)[trim(line.substr(0, equals))] = trim(line.substr(equals + 1));
+    }
+  }
+  if (!tierFound) {
+    throw std::runtime_error(
+        std::format("{} has no quality tier {}.", path, tier));
+  }
+  for (auto &[name, value] : tierValues) {
+    defaults[name] = value;
+  }
+  return defaults;
+}
+
+Specialization::Specialization(std::span<const uint32_t> code,
+                               const SpecValues &values) {
+  if (values.empty()) {
+    return;
+  }
+  std::unordered_map<uint32_t, std::string> names;
+  std::unordered_map<uint32_t, uint32_t> specIds;
+  std::unordered_map<uint32_t, Type> types;
+  std::vector<std::pair<uint32_t, Type>> specConstants;
+  forEachSpirvInstruction(code, [&](uint32_t opcode,
+                                    std::span<const uint32_t> operands) {
+    switch (opcode) {
+    case opName:
+      if (operands.size() >= 2) {
+        names[operands[0]] = spirvString(operands.subspan(1));
+      }
+      break;
+    case opDecorate:
+      if (operands.size() >= 3 && operands[1] == decorationSpecId) {
+        specIds[operands[0]] = operands[2];
+      }
+      break;
+    case opTypeBool:
+      types[operands[0]] = Type{Kind::Bool};
+      break;
+    case opTypeInt:
+      types[operands[0]] =
+          Type{operands[2] ? Kind::Int : Kind::Uint, operands[1]};
+      break;
+    case opTypeFloat:
+      types[operands[0]] = Type{Kind::Float, operands[1]};
+      break;
+    case opSpecConstantTrue:
+    case opSpecConstantFalse:
+    case opSpecConstant:
+      // Types are declared before the constants that use them.
+      if (auto type = types.find(operands[0]); type != types.end()) {
+        specConstants.emplace_back(operands[1], type->second);
+      }
+      break;
+    }
+  });
+
+  for (const auto &[result, type] : specConstants) {
+    auto specId = specIds.find(result);
+    if (specId == specIds.end()) {
+      continue;
+    }
+    auto value = values.find(std::to_string(specId->second));
+    std::string name = value != values.end() ? value->first : "";
+    if (auto named = names.find(result); named != names.end()) {
+      if (auto byName = values.find(named->second); byName != values.end()) {
+        value = byName;
+        name = named->second;
+      }
+    }
+    if (value != values.end()) {
+      constants[specId->second] = convert(name, value->second, type);
+    }
+  }
+}
+
+void Specialization::set(uint32_t id, uint32_t value) {
+  constants[id] = value;
+}
+
+vk::SpecializationInfo Specialization::info() {
+  entries.clear();
+  data.clear();
+  for (const auto &[id, value] : constants) {
+    entries.emplace_back(id,
+                         static_cast<uint32_t>(data.size() * sizeof(uint32_t)),
+                         sizeof(uint32_t));
+    data.push_back(value);
+  }
+  return vk::SpecializationInfo()
+      .setMapEntries(entries)
+      .setDataSize(data.size() * sizeof(uint32_t))
+      .setPData(data.data());
+}
+
+uint64_t Specialization::hash() const {
+  uint64_t hash = hashCombine(0, constants.size());
+  for (const auto &[id, value] : constants) {
+    hash = hashCombine(hash, (uint64_t(id) << 32) | value);
+  }
+  return hash;
+}
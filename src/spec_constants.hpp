@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// Specialization constant values by the constant's name, or by its
+// constant_id written as a number.
+using SpecValues = std::map<std::string, std::string>;
+
+// NAME=value lines; values after a "[tier]" line only apply to that quality
+// tier and override the ones before any section. '#' starts a comment.
+SpecValues loadSpecConfig(const std::string &path, const std::string &tier);
+
+// The specialization of one shader stage. Values are matched against the
+// module's OpSpecConstants by OpName (the GLSL variable name) or SpecId, and
+// converted to the constant's type (bool, 32-bit int or float). Values that
+// match nothing are ignored, since one set of values serves every pass.
+class Specialization {
+public:
+  Specialization(std::span<const uint32_t> code, const SpecValues &values);
+
+  // Sets a constant the application controls itself, such as the compute
+  // workgroup size.
+  void set(uint32_t id, uint32_t value);
+  // Points into this object, which must outlive its use.
+  vk::SpecializationInfo info();
+  // Of the ids and values, for pipeline keys.
+  uint64_t hash() const;
+
+private:
+  std::map<uint32_t, uint32_t> constants;
+  std::vector<vk::SpecializationMapEntry> entries;
+  std::vector<uint32_t> data;
+};
@@ -0,0 +1,723 @@
+#include "texture_loader.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+namespace {
+
+// Decoded texels of every layer, tightly packed.
+struct Pixels {
+  std::vector<uint8_t> bytes;
+  vk::Extent3D extent;
+  uint32_t layers = 1;
+  vk::Format format;
+};
+
+using StbPixels = std::unique_ptr<void, decltype(&stbi_image_free)>;
+
+// Linear filtering of 32-bit float formats is optional, of 16-bit ones
+// guaranteed, so float texels are uploaded as halves. Rounds to nearest
+// even; out of range values become infinity.
+void toHalves(const float *values, std::size_t count, uint8_t *target) {
+  const uint32_t denormMagic = 126u << 23;
+  for (std::size_t i = 0; i < count; i++) {
+    uint32_t bits = std::bit_cast<uint32_t>(values[i]);
+    const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    bits &= 0x7fffffff;
+    uint16_t half;
+    if (bits >= 0x47800000) {
+      half = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+    } else if (bits < 0x38800000) {
+      // Subnormal: the float addition does the rounding.
+      const float sum = std::bit_cast<float>(bits) +
+                        std::bit_cast<float>(denormMagic);
+      half = static_cast<uint16_t>(std::bit_cast<uint32_t>(sum) - denormMagic);
+    } else {
+      // Rebias the exponent and round the dropped mantissa bits.
+      bits += 0xc8000fffu + ((bits >> 13) & 1);
+      half = static_cast<uint16_t>(bits >> 13);
+    }
+    half |= sign;
+    std::memcpy(target + i * sizeof(half), &half, sizeof(half));
+  }
+}
+
+// ShaderToy samples 8-bit images as they are stored, without sRGB decoding.
+// Images are flipped so the first row is the bottom one, like ShaderToy's
+// default, except for cubemap faces.
+void appendImage(Pixels &pixels, const std::string &path, bool flip) {
+  int width = 0, height = 0, components = 0;
+  const bool hdr = stbi_is_hdr(path.c_str());
+  StbPixels data(hdr ? static_cast<void *>(stbi_loadf(
+                           path.c_str(), &width, &height, &components, 4))
+                     : static_cast<void *>(stbi_load(
+                           path.c_str(), &width, &height, &components, 4)),
+                 stbi_image_free);
+  if (!data) {
+    throw std::runtime_error(
+        std::format("Load {} failed: {}.", path, stbi_failure_reason()));
+  }
+
+  auto format =
+      hdr ? vk::Format::eR16G16B16A16Sfloat : vk::Format::eR8G8B8A8Unorm;
+  auto extent = vk::Extent3D(width, height, 1);
+  if (pixels.bytes.empty()) {
+    pixels.format = format;
+    pixels.extent = extent;
+  } else if (pixels.format != format || pixels.extent != extent) {
+    throw std::runtime_error(
+        std::format("{} doesn't match the other cubemap faces.", path));
+  }
+
+  const std::size_t rowTexels = std::size_t(width) * 4;
+  const std::size_t rowSize = rowTexels * (hdr ? 2 : 1);
+  const auto offset = pixels.bytes.size();
+  pixels.bytes.resize(offset + rowSize * height);
+  for (int row = 0; row < height; row++) {
+    int source = flip ? height - 1 - row : row;
+    uint8_t *target = pixels.bytes.data() + offset + row * rowSize;
+    if (hdr) {
+      toHalves(static_cast<const float *>(data.get()) + source * rowTexels,
+               rowTexels, target);
+    } else {
+      std::memcpy(target,
+                  static_cast<const uint8_t *>(data.get()) + source * rowSize,
+                  rowSize);
+    }
+  }
+}
+
+// ShaderToy's volume format: "BIN\0", width, height and depth as uint32,
+// channel count and layout as uint8, then a uint16 format (0 for 8-bit
+// unsigned, 10 for 32-bit float), followed by the texels.
+Pixels loadVolume(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error(std::format("Open {} failed.", path));
+  }
+  char magic[4];
+  uint32_t size[3];
+  uint8_t channels, layout;
+  uint16_t format;
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char *>(size), sizeof(size));
+  file.read(reinterpret_cast<char *>(&channels), 1);
+  file.read(reinterpret_cast<char *>(&layout), 1);
+  file.read(reinterpret_cast<char *>(&format), sizeof(format));
+  if (!file || std::memcmp(magic, "BIN", 4) != 0 || channels == 0 ||
+      channels > 4 || (format != 0 && format != 10)) {
+    throw std::runtime_error(std::format("{} is not a volume file.", path));
+  }
+
+  const std::size_t texelCount = std::size_t(size[0]) * size[1] * size[2];
+  std::vector<uint8_t> texels(texelCount * channels * (format == 0 ? 1 : 4));
+  file.read(reinterpret_cast<char *>(texels.data()), texels.size());
+  if (!file) {
+    throw std::runtime_error(std::format("{} is truncated.", path));
+  }
+  if (format != 0) {
+    std::vector<float> values(texelCount * channels);
+    std::memcpy(values.data(), texels.data(), texels.size());
+    texels.resize(values.size() * 2);
+    toHalves(values.data(), values.size(), texels.data());
+  }
+  const std::size_t componentSize = format == 0 ? 1 : 2;
+
+  Pixels pixels;
+  pixels.extent = vk::Extent3D(size[0], size[1], size[2]);
+  const std::array<vk::Format, 4> unorm = {
+      vk::Format::eR8Unorm, vk::Format::eR8G8Unorm, vk::Format::eR8G8B8A8Unorm,
+      vk::Format::eR8G8B8A8Unorm};
+  const std::array<vk::Format, 4> sfloat = {
+      vk::Format::eR16Sfloat, vk::Format::eR16G16Sfloat,
+      vk::Format::eR16G16B16A16Sfloat, vk::Format::eR16G16B16A16Sfloat};
+  pixels.format = (format == 0 ? unorm : sfloat)[channels - 1];
+  if (channels != 3) {
+    pixels.bytes = std::move(texels);
+    return pixels;
+  }
+
+  // Three-channel formats are rarely sampleable; pad to RGBA with alpha 1.
+  const uint16_t one = 0x3c00;
+  const uint8_t opaque = 255;
+  const void *alpha = format == 0 ? static_cast<const void *>(&opaque) : &one;
+  const std::size_t texelSize = 3 * componentSize;
+  pixels.bytes.resize(texelCount * 4 * componentSize);
+  for (std::size_t i = 0; i < texelCount; i++) {
+    uint8_t *target = pixels.bytes.data() + i * (texelSize + componentSize);
+    std::memcpy(target, texels.data() + i * texelSize, texelSize);
+    std::memcpy(target + texelSize, alpha, componentSize);
+  }
+  return pixels;
+}
+
+Pixels loadPixels(const std::string &path, vk::ImageViewType type) {
+  Pixels pixels;
+  if (type == vk::ImageViewType::e3D) {
+    return loadVolume(path);
+  }
+  if (type == vk::ImageViewType::eCube) {
+    if (path.find("{}") == std::string::npos) {
+      throw std::runtime_error(
+          std::format("Cubemap path {} needs a {{}} for the face.", path));
+    }
+    for (int face = 0; face < 6; face++) {
+      appendImage(pixels, std::vformat(path, std::make_format_args(face)),
+                  false);
+    }
+    if (pixels.extent.width != pixels.extent.height) {
+      throw std::runtime_error(
+          std::format("Cubemap faces of {} are not square.", path));
+    }
+    pixels.layers = 6;
+    return pixels;
+  }
+  appendImage(pixels, path, true);
+  return pixels;
+}
+
+vk::ImageSubresourceRange allLevels(uint32_t mipLevels, uint32_t layers) {
+  return vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0,
+                                   mipLevels, 0, layers);
+}
+
+vk::ImageMemoryBarrier imageBarrier(vk::Image image, vk::ImageLayout from,
+                                    vk::ImageLayout to,
+                                    vk::ImageSubresourceRange range) {
+  return vk::ImageMemoryBarrier()
+      .setOldLayout(from)
+      .setNewLayout(to)
+      .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+      .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+      .setImage(image)
+      .setSubresourceRange(range);
+}
+
+// Large enough for every format above, and a multiple of all their texel
+// sizes, as buffer-to-image copies require.
+const vk::DeviceSize stagingAlignment = 16;
+
+} // namespace
+
+TextureLoader::TextureLoader(const Context &context,
+                             vk::DeviceSize stagingSize, uint32_t workerCount)
+    : gpu(context.gpu), device(context.device),
+      graphicsQueue(context.graphicsQueue),
+      transferQueue(context.transferQueue),
+      graphicsFamily(context.graphicsFamily),
+      transferFamily(context.transferFamily),
+      allocator(context.allocator), queueMutex(context.queueMutex),
+      ring(stagingSize) {
+  graphicsPool = device.createCommandPool(
+      vk::CommandPoolCreateInfo()
+          .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+          .setQueueFamilyIndex(graphicsFamily));
+  if (transferFamily != graphicsFamily) {
+    transferPool = device.createCommandPool(
+        vk::CommandPoolCreateInfo()
+            .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+            .setQueueFamilyIndex(transferFamily));
+  }
+
+  repeatSampler = device.createSampler(
+      vk::SamplerCreateInfo()
+          .setMagFilter(vk::Filter::eLinear)
+          .setMinFilter(vk::Filter::eLinear)
+          .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+          .setAddressModeU(vk::SamplerAddressMode::eRepeat)
+          .setAddressModeV(vk::SamplerAddressMode::eRepeat)
+          .setAddressModeW(vk::SamplerAddressMode::eRepeat)
+          .setMaxLod(VK_LOD_CLAMP_NONE));
+
+  ringBuffer = device.createBuffer(
+      vk::BufferCreateInfo()
+          .setSize(stagingSize)
+          .setUsage(vk::BufferUsageFlagBits::eTransferSrc)
+          .setSharingMode(vk::SharingMode::eExclusive));
+  ringMemory = allocator->allocateBuffer(
+      ringBuffer, vk::MemoryPropertyFlagBits::eHostVisible |
+                      vk::MemoryPropertyFlagBits::eHostCoherent);
+
+  createPlaceholders();
+
+  workerCount = std::max(workerCount, 1u);
+  for (uint32_t i = 0; i < workerCount; i++) {
+    workers.emplace_back(&TextureLoader::work, this);
+  }
+}
+
+TextureLoader::~TextureLoader() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  jobQueued.notify_all();
+  ringFreed.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  for (auto &upload : uploads) {
+    if (device.waitForFences(upload.fence, VK_TRUE, UINT64_MAX) !=
+        vk::Result::eSuccess) {
+      std::cerr << "[textures] Wait for upload failed\n";
+    }
+    device.destroyFence(upload.fence);
+    device.destroySemaphore(upload.transferDone);
+    releaseStaging(upload.staging);
+  }
+  for (auto &entry : decoded) {
+    releaseStaging(entry.staging);
+  }
+
+  const auto destroy = [this](Texture &texture) {
+    device.destroyImageView(texture.view);
+    device.destroyImage(texture.image);
+    allocator->free(texture.memory);
+  };
+  for (auto &texture : textures) {
+    destroy(texture);
+  }
+  for (auto &placeholder : placeholders) {
+    destroy(placeholder);
+  }
+
+  device.destroyBuffer(ringBuffer);
+  allocator->free(ringMemory);
+  device.destroySampler(repeatSampler);
+  device.destroyCommandPool(graphicsPool);
+  device.destroyCommandPool(transferPool);
+}
+
+TextureLoader::TextureId TextureLoader::request(const std::string &path,
+                                                vk::ImageViewType type) {
+  auto &texture = textures.emplace_back();
+  texture.id = static_cast<TextureId>(textures.size() - 1);
+  texture.path = path;
+  texture.type = type;
+  {
+    std::lock_guard lock(mutex);
+    jobs.push_back(&texture);
+    unsettled++;
+  }
+  jobQueued.notify_one();
+  return texture.id;
+}
+
+vk::ImageView TextureLoader::view(TextureId id) const {
+  const auto &texture = textures[id];
+  if (texture.ready) {
+    return texture.view;
+  }
+  switch (texture.type) {
+  case vk::ImageViewType::eCube:
+    return placeholders[1].view;
+  case vk::ImageViewType::e3D:
+    return placeholders[2].view;
+  default:
+    return placeholders[0].view;
+  }
+}
+
+void TextureLoader::update(
+    const std::function<void(TextureId, vk::ImageView)> &onReady) {
+  // Uploads finish in submission order.
+  while (!uploads.empty() &&
+         device.getFenceStatus(uploads.front().fence) ==
+             vk::Result::eSuccess) {
+    auto &upload = uploads.front();
+    device.freeCommandBuffers(graphicsPool, upload.graphicsCommands);
+    if (upload.transferCommands) {
+      device.freeCommandBuffers(transferPool, upload.transferCommands);
+    }
+    device.destroySemaphore(upload.transferDone);
+    device.destroyFence(upload.fence);
+    releaseStaging(upload.staging);
+    uploads.pop_front();
+  }
+
+  {
+    std::lock_guard lock(mutex);
+    submitting.swap(decoded);
+    unsettled -= submitting.size();
+  }
+  for (const auto &entry : submitting) {
+    submitUpload(entry);
+    auto *texture = entry.texture;
+    texture->ready = true;
+    onReady(texture->id, texture->view);
+  }
+  submitting.clear();
+}
+
+bool TextureLoader::loading() {
+  std::lock_guard lock(mutex);
+  return unsettled > 0;
+}
+
+void TextureLoader::work() {
+  while (true) {
+    Texture *texture;
+    {
+      std::unique_lock lock(mutex);
+      jobQueued.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      if (stopping) {
+        return;
+      }
+      texture = jobs.front();
+      jobs.pop_front();
+    }
+
+    try {
+      auto entry = decode(*texture);
+      std::lock_guard lock(mutex);
+      decoded.push_back(entry);
+    } catch (const std::exception &e) {
+      device.destroyImageView(texture->view);
+      device.destroyImage(texture->image);
+      allocator->free(texture->memory);
+      texture->view = nullptr;
+      texture->image = nullptr;
+      texture->memory = {};
+      std::lock_guard lock(mutex);
+      unsettled--;
+      if (!stopping) {
+        std::cerr << std::format("[textures] {}\n", e.what());
+      }
+    }
+  }
+}
+
+TextureLoader::Decoded TextureLoader::decode(Texture &texture) {
+  auto pixels = loadPixels(texture.path, texture.type);
+
+  Decoded entry;
+  entry.texture = &texture;
+  entry.extent = pixels.extent;
+  entry.layers = pixels.layers;
+  entry.mipLevels = 1;
+  // Mips are blitted with linear filtering, which not every format allows.
+  const auto blitFeatures =
+      vk::FormatFeatureFlagBits::eBlitSrc |
+      vk::FormatFeatureFlagBits::eBlitDst |
+      vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+  auto features = gpu.getFormatProperties(pixels.format).optimalTilingFeatures;
+  if ((features & blitFeatures) == blitFeatures) {
+    entry.mipLevels = std::bit_width(std::max(
+        {pixels.extent.width, pixels.extent.height, pixels.extent.depth}));
+  }
+
+  const bool cube = texture.type == vk::ImageViewType::eCube;
+  auto usage = vk::ImageUsageFlagBits::eTransferDst |
+               vk::ImageUsageFlagBits::eSampled;
+  if (entry.mipLevels > 1) {
+    usage |= vk::ImageUsageFlagBits::eTransferSrc;
+  }
+  texture.image = device.createImage(
+      vk::ImageCreateInfo()
+          .setFlags(cube ? vk::ImageCreateFlagBits::eCubeCompatible
+                         : vk::ImageCreateFlags())
+          .setImageType(texture.type == vk::ImageViewType::e3D
+                            ? vk::ImageType::e3D
+                            : vk::ImageType::e2D)
+          .setFormat(pixels.format)
+          .setExtent(pixels.extent)
+          .setMipLevels(entry.mipLevels)
+          .setArrayLayers(pixels.layers)
+          .setSamples(vk::SampleCountFlagBits::e1)
+          .setTiling(vk::ImageTiling::eOptimal)
+          .setUsage(usage)
+          .setSharingMode(vk::SharingMode::eExclusive)
+          .setInitialLayout(vk::ImageLayout::eUndefined));
+  texture.memory = allocator->allocateImage(
+      texture.image, vk::MemoryPropertyFlagBits::eDeviceLocal);
+  texture.view = device.createImageView(
+      vk::ImageViewCreateInfo()
+          .setImage(texture.image)
+          .setViewType(texture.type)
+          .setFormat(pixels.format)
+          .setSubresourceRange(allLevels(entry.mipLevels, pixels.layers)));
+
+  entry.staging = reserveStaging(pixels.bytes.size());
+  std::memcpy(entry.staging.data, pixels.bytes.data(), pixels.bytes.size());
+  return entry;
+}
+
+TextureLoader::Staging TextureLoader::reserveStaging(vk::DeviceSize size) {
+  Staging staging;
+  if (size > ring.size() / 2) {
+    // Too big to share the ring without stalling everything behind it.
+    staging.buffer = device.createBuffer(
+        vk::BufferCreateInfo()
+            .setSize(size)
+            .setUsage(vk::BufferUsageFlagBits::eTransferSrc)
+            .setSharingMode(vk::SharingMode::eExclusive));
+    staging.memory = allocator->allocateBuffer(
+        staging.buffer, vk::MemoryPropertyFlagBits::eHostVisible |
+                            vk::MemoryPropertyFlagBits::eHostCoherent);
+    staging.data = staging.memory.data;
+    return staging;
+  }
+
+  std::unique_lock lock(mutex);
+  std::optional<vk::DeviceSize> offset;
+  ringFreed.wait(lock, [&]() {
+    return stopping || (offset = ring.allocate(size, stagingAlignment));
+  });
+  if (stopping) {
+    throw std::runtime_error("Texture loader stopped.");
+  }
+  staging.buffer = ringBuffer;
+  staging.offset = *offset;
+  staging.data = ringMemory.data + *offset;
+  return staging;
+}
+
+void TextureLoader::releaseStaging(const Staging &staging) {
+  if (staging.memory) {
+    device.destroyBuffer(staging.buffer);
+    allocator->free(staging.memory);
+    return;
+  }
+  {
+    std::lock_guard lock(mutex);
+    ring.release(staging.offset);
+  }
+  ringFreed.notify_all();
+}
+
+void TextureLoader::submitUpload(const Decoded &entry) {
+  Upload upload;
+  upload.staging = entry.staging;
+  upload.fence = device.createFence(vk::FenceCreateInfo());
+  const bool transfer = transferFamily != graphicsFamily;
+  upload.graphicsCommands = beginCommands(graphicsPool);
+  if (transfer) {
+    upload.transferCommands = beginCommands(transferPool);
+    upload.transferDone = device.createSemaphore(vk::SemaphoreCreateInfo());
+    recordCopy(upload.transferCommands, entry);
+    upload.transferCommands.end();
+    std::lock_guard lock(*queueMutex);
+    transferQueue.submit(vk::SubmitInfo()
+                             .setCommandBuffers(upload.transferCommands)
+                             .setSignalSemaphores(upload.transferDone));
+  } else {
+    recordCopy(upload.graphicsCommands, entry);
+  }
+  recordMips(upload.graphicsCommands, entry);
+  upload.graphicsCommands.end();
+
+  const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eTransfer;
+  auto submit = vk::SubmitInfo().setCommandBuffers(upload.graphicsCommands);
+  if (transfer) {
+    submit.setWaitSemaphores(upload.transferDone)
+        .setWaitDstStageMask(waitStage);
+  }
+  {
+    std::lock_guard lock(*queueMutex);
+    graphicsQueue.submit(submit, upload.fence);
+  }
+  uploads.push_back(upload);
+}
+
+void TextureLoader::recordCopy(vk::CommandBuffer commandBuffer,
+                               const Decoded &entry) {
+  auto image = entry.texture->image;
+  auto range = allLevels(entry.mipLevels, entry.layers);
+  auto toTransfer = imageBarrier(image, vk::ImageLayout::eUndefined,
+                                 vk::ImageLayout::eTransferDstOptimal, range)
+                        .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                vk::PipelineStageFlagBits::eTransfer, {},
+                                nullptr, nullptr, toTransfer);
+
+  auto region = vk::BufferImageCopy()
+                    .setBufferOffset(entry.staging.offset)
+                    .setImageSubresource(vk::ImageSubresourceLayers(
+                        vk::ImageAspectFlagBits::eColor, 0, 0, entry.layers))
+                    .setImageExtent(entry.extent);
+  commandBuffer.copyBufferToImage(entry.staging.buffer, image,
+                                  vk::ImageLayout::eTransferDstOptimal, region);
+
+  if (transferFamily != graphicsFamily) {
+    // Release to the graphics family; recordMips() records the matching
+    // acquire.
+    auto release = imageBarrier(image, vk::ImageLayout::eTransferDstOptimal,
+                                vk::ImageLayout::eTransferDstOptimal, range)
+                       .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                       .setSrcQueueFamilyIndex(transferFamily)
+                       .setDstQueueFamilyIndex(graphicsFamily);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eBottomOfPipe, {},
+                                  nullptr, nullptr, release);
+  }
+}
+
+void TextureLoader::recordMips(vk::CommandBuffer commandBuffer,
+                               const Decoded &entry) {
+  auto image = entry.texture->image;
+  if (transferFamily != graphicsFamily) {
+    auto acquire =
+        imageBarrier(image, vk::ImageLayout::eTransferDstOptimal,
+                     vk::ImageLayout::eTransferDstOptimal,
+                     allLevels(entry.mipLevels, entry.layers))
+            .setDstAccessMask(vk::AccessFlagBits::eTransferRead |
+                              vk::AccessFlagBits::eTransferWrite)
+            .setSrcQueueFamilyIndex(transferFamily)
+            .setDstQueueFamilyIndex(graphicsFamily);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                  vk::PipelineStageFlagBits::eTransfer, {},
+                                  nullptr, nullptr, acquire);
+  }
+
+  // Each level is blitted from the one above it, which is then done and
+  // moved to TransferSrc.
+  const auto level = [&](uint32_t mip) {
+    return vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, mip, 1, 0,
+                                     entry.layers);
+  };
+  const auto mipOffset = [&](uint32_t mip) {
+    return vk::Offset3D(std::max(entry.extent.width >> mip, 1u),
+                        std::max(entry.extent.height >> mip, 1u),
+                        std::max(entry.extent.depth >> mip, 1u));
+  };
+  for (uint32_t mip = 1; mip < entry.mipLevels; mip++) {
+    auto source = imageBarrier(image, vk::ImageLayout::eTransferDstOptimal,
+                               vk::ImageLayout::eTransferSrcOptimal,
+                               level(mip - 1))
+                      .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                      .setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eTransfer, {},
+                                  nullptr, nullptr, source);
+    auto blit =
+        vk::ImageBlit()
+            .setSrcSubresource(vk::ImageSubresourceLayers(
+                vk::ImageAspectFlagBits::eColor, mip - 1, 0, entry.layers))
+            .setSrcOffsets({vk::Offset3D(), mipOffset(mip - 1)})
+            .setDstSubresource(vk::ImageSubresourceLayers(
+                vk::ImageAspectFlagBits::eColor, mip, 0, entry.layers))
+            .setDstOffsets({vk::Offset3D(), mipOffset(mip)});
+    commandBuffer.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image,
+                            vk::ImageLayout::eTransferDstOptimal, blit,
+                            vk::Filter::eLinear);
+  }
+
+  std::vector<vk::ImageMemoryBarrier> toShader;
+  if (entry.mipLevels > 1) {
+    toShader.push_back(
+        imageBarrier(image, vk::ImageLayout::eTransferSrcOptimal,
+                     vk::ImageLayout::eShaderReadOnlyOptimal,
+                     vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor,
+                                               0, entry.mipLevels - 1, 0,
+                                               entry.layers))
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferRead));
+  }
+  toShader.push_back(imageBarrier(image, vk::ImageLayout::eTransferDstOptimal,
+                                  vk::ImageLayout::eShaderReadOnlyOptimal,
+                                  level(entry.mipLevels - 1))
+                         .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite));
+  for (auto &barrier : toShader) {
+    barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+  }
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eFragmentShader |
+                                    vk::PipelineStageFlagBits::eComputeShader,
+                                {}, nullptr, nullptr, toShader);
+}
+
+void TextureLoader::createPlaceholders() {
+  const std::array<vk::ImageViewType, 3> types = {
+      vk::ImageViewType::e2D, vk::ImageViewType::eCube, vk::ImageViewType::e3D};
+  auto commandBuffer = beginCommands(graphicsPool);
+
+  for (std::size_t i = 0; i < types.size(); i++) {
+    auto &placeholder = placeholders[i];
+    const bool cube = types[i] == vk::ImageViewType::eCube;
+    const uint32_t layers = cube ? 6 : 1;
+    placeholder.type = types[i];
+    placeholder.image = device.createImage(
+        vk::ImageCreateInfo()
+            .setFlags(cube ? vk::ImageCreateFlagBits::eCubeCompatible
+                           : vk::ImageCreateFlags())
+            .setImageType(types[i] == vk::ImageViewType::e3D
+                              ? vk::ImageType::e3D
+                              : vk::ImageType::e2D)
+            .setFormat(vk::Format::eR8G8B8A8Unorm)
+            .setExtent(vk::Extent3D(1, 1, 1))
+            .setMipLevels(1)
+            .setArrayLayers(layers)
+            .setSamples(vk::SampleCountFlagBits::e1)
+            .setTiling(vk::ImageTiling::eOptimal)
+            .setUsage(vk::ImageUsageFlagBits::eTransferDst |
+                      vk::ImageUsageFlagBits::eSampled)
+            .setSharingMode(vk::SharingMode::eExclusive)
+            .setInitialLayout(vk::ImageLayout::eUndefined));
+    placeholder.memory = allocator->allocateImage(
+        placeholder.image, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    placeholder.view = device.createImageView(
+        vk::ImageViewCreateInfo()
+            .setImage(placeholder.image)
+            .setViewType(types[i])
+            .setFormat(vk::Format::eR8G8B8A8Unorm)
+            .setSubresourceRange(allLevels(1, layers)));
+
+    auto range = allLevels(1, layers);
+    auto toClear =
+        imageBarrier(placeholder.image, vk::ImageLayout::eUndefined,
+                     vk::ImageLayout::eTransferDstOptimal, range)
+            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                  vk::PipelineStageFlagBits::eTransfer, {},
+                                  nullptr, nullptr, toClear);
+    commandBuffer.clearColorImage(
+        placeholder.image, vk::ImageLayout::eTransferDstOptimal,
+        vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f}),
+        range);
+    auto toShader =
+        imageBarrier(placeholder.image, vk::ImageLayout::eTransferDstOptimal,
+                     vk::ImageLayout::eShaderReadOnlyOptimal, range)
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eFragmentShader |
+                                      vk::PipelineStageFlagBits::eComputeShader,
+                                  {}, nullptr, nullptr, toShader);
+  }
+
+  commandBuffer.end();
+  auto fence = device.createFence(vk::FenceCreateInfo());
+  {
+    std::lock_guard lock(*queueMutex);
+    graphicsQueue.submit(vk::SubmitInfo().setCommandBuffers(commandBuffer),
+                         fence);
+  }
+  auto result = device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+  device.destroyFence(fence);
+  device.freeCommandBuffers(graphicsPool, commandBuffer);
+  if (result != vk::Result::eSuccess) {
+    throw std::runtime_error("Clear texture placeholders failed.");
+  }
+}
+
+vk::CommandBuffer TextureLoader::beginCommands(vk::CommandPool pool) {
+  auto commandBuffer = device
+                           .allocateCommandBuffers(
+                               vk::CommandBufferAllocateInfo()
+                                   .setCommandPool(pool)
+                                   .setLevel(vk::CommandBufferLevel::ePrimary)
+                                   .setCommandBufferCount(1))
+                           .front();
+  commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+  return commandBuffer;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "memory_allocator.hpp"
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// Loads iChannel textures (2D images, cubemaps and ShaderToy .bin volumes)
+// in the background. Worker threads decode the files, create the images and
+// fill a staging ring; the render thread only records and submits the
+// copies. Copies go through a dedicated transfer queue when the device has
+// one, and mip chains are blitted on the graphics queue. Until a texture is
+// ready its view is a black placeholder of the same type, so rendering can
+// start right away.
+class TextureLoader {
+public:
+  using TextureId = uint32_t;
+
+  struct Context {
+    vk::PhysicalDevice gpu;
+    vk::Device device;
+    vk::Queue graphicsQueue;
+    uint32_t graphicsFamily;
+    // The graphics queue again when there is no separate transfer family.
+    vk::Queue transferQueue;
+    uint32_t transferFamily;
+    MemoryAllocator *allocator;
+    // Held around submissions, as other threads may use the same queues.
+    std::mutex *queueMutex;
+  };
+
+  TextureLoader(const Context &context, vk::DeviceSize stagingSize,
+                uint32_t workerCount);
+  ~TextureLoader();
+
+  TextureLoader(const TextureLoader &) = delete;
+  TextureLoader &operator=(const TextureLoader &) = delete;
+
+  // `type` is e2D, eCube or e3D. A cubemap path contains "{}", replaced by
+  // the face index 0-5 (+X, -X, +Y, -Y, +Z, -Z).
+  TextureId request(const std::string &path, vk::ImageViewType type);
+  vk::ImageView view(TextureId texture) const;
+  // Repeat addressing with trilinear filtering, as ShaderToy defaults to.
+  vk::Sampler sampler() const { return repeatSampler; }
+
+  // Called on the render thread before each frame is submitted. Submits the
+  // uploads of decoded textures and reports every texture that is usable by
+  // work submitted from now on.
+  void update(const std::function<void(TextureId, vk::ImageView)> &onReady);
+  // Whether a requested texture has neither been reported ready nor failed.
+  bool loading();
+
+private:
+  struct Texture {
+    TextureId id = 0;
+    std::string path;
+    vk::ImageViewType type;
+    vk::Image image;
+    Allocation memory;
+    vk::ImageView view;
+    bool ready = false;
+  };
+
+  struct Staging {
+    vk::Buffer buffer;
+    vk::DeviceSize offset = 0;
+    uint8_t *data = nullptr;
+    // Only set for a buffer of its own instead of a range of the ring.
+    Allocation memory;
+  };
+
+  struct Decoded {
+    Texture *texture;
+    vk::Extent3D extent;
+    uint32_t layers;
+    uint32_t mipLevels;
+    Staging staging;
+  };
+
+  struct Upload {
+    vk::CommandBuffer transferCommands;
+    vk::CommandBuffer graphicsCommands;
+    vk::Semaphore transferDone;
+    vk::Fence fence;
+    Staging staging;
+  };
+
+  void work();
+  Decoded decode(Texture &texture);
+  Staging reserveStaging(vk::DeviceSize size);
+  void releaseStaging(const Staging &staging);
+  void submitUpload(const Decoded &decoded);
+  void recordCopy(vk::CommandBuffer commandBuffer, const Decoded &decoded);
+  void recordMips(vk::CommandBuffer commandBuffer, const Decoded &decoded);
+  void createPlaceholders();
+  vk::CommandBuffer beginCommands(vk::CommandPool pool);
+
+  vk::PhysicalDevice gpu;
+  vk::Device device;
+  vk::Queue graphicsQueue, transferQueue;
+  uint32_t graphicsFamily, transferFamily;
+  MemoryAllocator *allocator;
+  std::mutex *queueMutex;
+
+  vk::CommandPool graphicsPool, transferPool;
+  vk::Sampler repeatSampler;
+  // 2D, cube and 3D placeholders.
+  std::array<Texture, 3> placeholders;
+
+  // Only touched by the render thread, apart from the workers filling in
+  // the image of the entry they were handed.
+  std::deque<Texture> textures;
+  std::deque<Upload> uploads;
+  std::vector<Decoded> submitting;
+
+  vk::Buffer ringBuffer;
+  Allocation ringMemory;
+
+  std::mutex mutex;
+  std::condition_variable jobQueued, ringFreed;
+  std::deque<Texture *> jobs;
+  std::vector<Decoded> decoded;
+  // Requested textures that are neither ready nor failed.
+  std::size_t unsettled = 0;
+  RingAllocator ring;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+};
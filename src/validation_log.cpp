@@ -0,0 +1,198 @@
+#include "validation_log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <iostream>
+
+namespace {
+
+template <std::size_t N>
+void copyTruncated(std::array<char, N> &target, const char *text) {
+  const std::size_t length = text ? std::min(std::strlen(text), N - 1) : 0;
+  std::memcpy(target.data(), text ? text : "", length);
+  target[length] = '\0';
+}
+
+const char *severityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+  switch (severity) {
+  case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
+    return "Info";
+  case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
+    return "Verbose";
+  case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
+    return "Warning";
+  default:
+    return "Error";
+  }
+}
+
+} // namespace
+
+ValidationLog::ValidationLog(Severities severities, Types types,
+                             uint32_t repeatLimit)
+    : repeatLimit(repeatLimit),
+      severities(static_cast<uint32_t>(severities)),
+      types(static_cast<uint32_t>(types)) {
+  for (std::size_t i = 0; i < ring.size(); i++) {
+    ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  thread = std::thread(&ValidationLog::run, this);
+}
+
+ValidationLog::~ValidationLog() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  stopRequested.notify_one();
+  thread.join();
+}
+
+void ValidationLog::setFilter(Severities severities, Types types) {
+  this->severities.store(static_cast<uint32_t>(severities),
+                         std::memory_order_relaxed);
+  this->types.store(static_cast<uint32_t>(types), std::memory_order_relaxed);
+}
+
+VkBool32 ValidationLog::callback(
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT types,
+    const VkDebugUtilsMessengerCallbackDataEXT *data, void *userData) {
+  auto *log = static_cast<ValidationLog *>(userData);
+  if (!(severity & log->severities.load(std::memory_order_relaxed)) ||
+      !(types & log->types.load(std::memory_order_relaxed))) {
+    return VK_FALSE;
+  }
+  // Messages without an ID can't be told apart, so each one is printed.
+  uint32_t occurrence = 1;
+  if (data->messageIdNumber != 0) {
+    if (auto *counter = log->counter(data->messageIdNumber)) {
+      occurrence = counter->count.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+  }
+  if (occurrence <= log->repeatLimit) {
+    log->push(severity, data->messageIdNumber, occurrence,
+              data->pMessageIdName, data->pMessage);
+  }
+  return VK_FALSE;
+}
+
+// Open addressing; slots are claimed once and never freed. Null when the
+// table is full, in which case the message is not deduplicated.
+ValidationLog::Counter *ValidationLog::counter(int32_t id) {
+  const auto start = static_cast<uint32_t>(id) * 2654435761u;
+  for (std::size_t probe = 0; probe < counters.size(); probe++) {
+    auto &slot = counters[(start + probe) % counters.size()];
+    int64_t current = slot.id.load(std::memory_order_acquire);
+    if (current == emptyId &&
+        slot.id.compare_exchange_strong(current, id,
+                                        std::memory_order_acq_rel)) {
+      return &slot;
+    }
+    if (current == id) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+void ValidationLog::push(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+                         int32_t id, uint32_t occurrence, const char *name,
+                         const char *message) {
+  auto position = writePosition.load(std::memory_order_relaxed);
+  Entry *entry;
+  while (true) {
+    entry = &ring[position % ring.size()];
+    const auto sequence = entry->sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      if (writePosition.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < position) {
+      // Still holds a message from one lap ago: the ring is full.
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = writePosition.load(std::memory_order_relaxed);
+    }
+  }
+  entry->severity = severity;
+  entry->id = id;
+  entry->occurrence = occurrence;
+  copyTruncated(entry->name, name);
+  copyTruncated(entry->message, message);
+  entry->sequence.store(position + 1, std::memory_order_release);
+}
+
+void ValidationLog::run() {
+  using namespace std::chrono_literals;
+  auto nextSummary = std::chrono::steady_clock::now() + 1s;
+  std::string out;
+  while (true) {
+    bool stop;
+    {
+      std::unique_lock lock(mutex);
+      stop = stopRequested.wait_for(lock, 50ms, [this]() { return stopping; });
+    }
+    drain(out);
+    if (stop || std::chrono::steady_clock::now() >= nextSummary) {
+      summarize(out);
+      nextSummary = std::chrono::steady_clock::now() + 1s;
+    }
+    if (!out.empty()) {
+      std::cerr << out;
+      out.clear();
+    }
+    if (stop) {
+      return;
+    }
+  }
+}
+
+void ValidationLog::drain(std::string &out) {
+  while (true) {
+    auto &entry = ring[readPosition % ring.size()];
+    if (entry.sequence.load(std::memory_order_acquire) != readPosition + 1) {
+      return;
+    }
+    out += std::format("[validation layer] {}: {}\n",
+                       severityName(entry.severity), entry.message.data());
+    if (entry.id != 0) {
+      names.try_emplace(entry.id, entry.name.data());
+      if (entry.occurrence == repeatLimit) {
+        out += std::format("[validation layer] Counting further repeats of "
+                           "{} instead of printing them\n",
+                           entry.name.data());
+      }
+    }
+    entry.sequence.store(readPosition + ring.size(),
+                         std::memory_order_release);
+    readPosition++;
+  }
+}
+
+void ValidationLog::summarize(std::string &out) {
+  for (auto &slot : counters) {
+    const auto id = slot.id.load(std::memory_order_acquire);
+    if (id == emptyId) {
+      continue;
+    }
+    const auto count = slot.count.load(std::memory_order_relaxed);
+    const auto reported = std::max(slot.reported, repeatLimit);
+    if (count <= reported) {
+      continue;
+    }
+    const auto name = names.find(static_cast<int32_t>(id));
+    const auto label = name != names.end()
+                           ? name->second
+                           : std::format("{:#010x}", uint32_t(id));
+    out += std::format("[validation layer] {} repeated {} more times\n", label,
+                       count - reported);
+    slot.reported = count;
+  }
+  if (const auto lost = dropped.exchange(0, std::memory_order_relaxed)) {
+    out += std::format("[validation layer] {} messages dropped\n", lost);
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vulkan/vulkan.hpp>
+
+// Validation layer messages, printed off the driver's calling thread. The
+// debug callback never locks or allocates: it counts the message per
+// messageIdNumber in a lock-free table and copies it into a bounded lock-free
+// ring, which a background thread drains and prints. Each message ID is
+// printed at most `repeatLimit` times; later occurrences are only counted
+// and summarized once per second. When the ring is full, messages are
+// dropped rather than stalling the caller, and the drops are reported.
+class ValidationLog {
+public:
+  using Severities = vk::DebugUtilsMessageSeverityFlagsEXT;
+  using Types = vk::DebugUtilsMessageTypeFlagsEXT;
+
+  ValidationLog(Severities severities, Types types, uint32_t repeatLimit);
+  // Prints what is left, with the final repeat counts.
+  ~ValidationLog();
+
+  ValidationLog(const ValidationLog &) = delete;
+  ValidationLog &operator=(const ValidationLog &) = delete;
+
+  // Takes effect for the next message; safe from any thread.
+  void setFilter(Severities severities, Types types);
+
+  // The messenger's callback, with the log as its user data.
+  static VKAPI_ATTR VkBool32 VKAPI_CALL
+  callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+           VkDebugUtilsMessageTypeFlagsEXT types,
+           const VkDebugUtilsMessengerCallbackDataEXT *data, void *log);
+
+private:
+  static constexpr std::size_t ringSize = 256;
+  static constexpr std::size_t tableSize = 1024;
+  static constexpr int64_t emptyId = INT64_MIN;
+
+  struct Entry {
+    // Vyukov's bounded queue: the position the slot is next written at,
+    // plus one once it holds that position's message.
+    std::atomic<uint64_t> sequence;
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+    int32_t id;
+    uint32_t occurrence;
+    std::array<char, 64> name;
+    std::array<char, 1024> message;
+  };
+
+  struct Counter {
+    std::atomic<int64_t> id = emptyId;
+    std::atomic<uint32_t> count = 0;
+    // Occurrences accounted for so far; drain thread only.
+    uint32_t reported = 0;
+  };
+
+  Counter *counter(int32_t id);
+  void push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, int32_t id,
+            uint32_t occurrence, const char *name, const char *message);
+  void run();
+  void drain(std::string &out);
+  void summarize(std::string &out);
+
+  uint32_t repeatLimit;
+  std::atomic<uint32_t> severities;
+  std::atomic<uint32_t> types;
+
+  std::array<Entry, ringSize> ring;
+  std::atomic<uint64_t> writePosition = 0;
+  uint64_t readPosition = 0;
+  std::atomic<uint64_t> dropped = 0;
+  std::array<Counter, tableSize> counters;
+  // Names of the IDs seen, for the summaries; drain thread only.
+  std::unordered_map<int32_t, std::string> names;
+
+  std::mutex mutex;
+  std::condition_variable stopRequested;
+  bool stopping = false;
+  std::thread thread;
+};
@@ -1,14 +1,20 @@
 #include "vulkan.hpp"
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
-#define GLFW_EXPOSE_NATIVE_WIN32
+#include "hash.hpp"
 #include "shader.hpp"
-#include <GLFW/glfw3native.h>
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <ctime>
 #include <format>
 #include <iostream>
+#include <map>
 #include <ranges>
 #include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #ifdef NDEBUG
@@ -17,18 +23,105 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
+VulkanApp::VulkanApp(const AppOptions &options)
+    : options(options), shaderCompiler(options.shaderCacheDir) {}
+
+VulkanApp::VulkanApp(const AppOptions &options, VulkanApp &owner)
+    : options(options), shaderCompiler(options.shaderCacheDir) {
+  this->options.headless = true;
+  sharedDevice = true;
+  instance = owner.instance;
+  gpu = owner.gpu;
+  device = owner.device;
+  graphicQueue = owner.graphicQueue;
+  transferQueue = owner.transferQueue;
+  allocator = owner.allocator;
+  queueMutex = owner.queueMutex;
+  queueFamilyProps = owner.queueFamilyProps;
+  graphicIndex = owner.graphicIndex;
+  transferIndex = owner.transferIndex;
+  deviceExtensions = owner.deviceExtensions;
+  memoryBudget = owner.memoryBudget;
+  pipelineCache = owner.pipelineCache;
+  shaderModules = owner.shaderModules;
+}
+
 /** Vulkan **/
-void VulkanApp::initVulkan() {
+void VulkanApp::initDevice() {
   createInstance();
-  setupDebugMessenger();
-  createSurface();
+  if (enableValidationLayers) {
+    setupDebugMessenger();
+  }
+  if (!options.headless) {
+    createSurface();
+  }
   pickPhysicalDevice();
   createLogicalDevice();
-  createSwapChain();
+  createPipelineCache();
+  queueMutex = std::make_shared<std::mutex>();
+}
+
+// Also undoes a partial initDevice().
+void VulkanApp::destroyDevice() {
+  if (pipelineCache) {
+    pipelineCache->save();
+    pipelineCache->destroy();
+  }
+  if (shaderModules) {
+    shaderModules->destroy();
+  }
+  allocator.reset();
+  if (device) {
+    device.destroy();
+  }
+
+  if (surface) {
+    instance.destroySurfaceKHR(surface);
+  }
+  validationWatcher.reset();
+  if (debugMessenger) {
+    instance.destroyDebugUtilsMessengerEXT(debugMessenger, nullptr,
+                                           debugDispatch);
+  }
+  validationLog.reset();
+  instance.destroy();
+}
+
+void VulkanApp::initVulkan() {
+  if (!sharedDevice) {
+    initDevice();
+  }
+  if (options.headless) {
+    createOffscreenTargets();
+  } else {
+    createSwapChain();
+  }
   createImageView();
-  createGraphicPipline();
   createRenderPass();
-  present();
+  createDescriptorSetLayout();
+  createShaderInputs();
+  createTextureLoader();
+  // The graph gives a scaled Image pass its own target.
+  if (options.targetFrameMs > 0.0f) {
+    resolutionScaler.emplace(options.targetFrameMs, options.minScale,
+                             options.framesInFlight);
+  }
+  createRenderGraph();
+  createGraphicPipline();
+  createFrambuffers();
+  createCommandBuffers();
+  createSyncObjects();
+  if (!options.exportPath.empty()) {
+    createFrameExporter();
+  }
+  if (options.accumulate) {
+    createAccumulator();
+  }
+  // The scaler is driven by the profiler's GPU frame times.
+  if (options.profile || resolutionScaler) {
+    profiler.init(gpu, device, graphicQueue, graphicIndex, frames.size(),
+                  queueMutex.get());
+  }
 }
 
 bool checkValidationLayerSupport(const std::vector<const char *> &layerNames) {
@@ -43,32 +136,6 @@ bool checkValidationLayerSupport(const std::vector<const char *> &layerNames) {
       });
 }
 
-static VKAPI_ATTR vk::Bool32 VKAPI_CALL
-debugCallback(vk::DebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-              vk::DebugUtilsMessageTypeFlagsEXT messageType,
-              const vk::DebugUtilsMessengerCallbackDataEXT *pCallbackData,
-              void *pUserData) {
-
-  using DebugSeverityFlag = vk::DebugUtilsMessageSeverityFlagBitsEXT;
-  using std::format;
-
-  const auto message = [pCallbackData, messageSeverity]() {
-    switch (messageSeverity) {
-    case DebugSeverityFlag::eInfo:
-      return format("Info: {}", pCallbackData->pMessage);
-    case DebugSeverityFlag::eVerbose:
-      return format("Verbose: {}", pCallbackData->pMessage);
-    case DebugSeverityFlag::eWarning:
-      return format("Warning: {}", pCallbackData->pMessage);
-    default:
-      return format("Error: {}", pCallbackData->pMessage);
-    }
-  }();
-  auto formattedMessage = format("[validation layer] {}\n", message);
-  std::cerr << formattedMessage;
-  return VK_FALSE;
-}
-
 void VulkanApp::createInstance() {
 
   // Create instance
@@ -80,15 +147,30 @@ void VulkanApp::createInstance() {
                               .engineVersion = VK_MAKE_VERSION(1, 0, 0),
                               .apiVersion = VK_API_VERSION_1_3};
 
-    static const std::vector<const char *> validationLayers{
-        "VK_LAYER_KHRONOS_validation", "VK_LAYER_LUNARG_monitor"};
+    // The monitor layer draws into the window title, so it is useless (and
+    // often missing) on display-less machines.
+    std::vector<const char *> validationLayers;
+    if (enableValidationLayers) {
+      validationLayers.push_back("VK_LAYER_KHRONOS_validation");
+      if (!options.headless) {
+        validationLayers.push_back("VK_LAYER_LUNARG_monitor");
+      }
+    }
     if (enableValidationLayers &&
         !checkValidationLayerSupport(validationLayers)) {
       throw std::runtime_error("Not support validation layer");
     }
 
-    instanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
-    instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+    if (!options.headless) {
+      uint32_t glfwExtensionCount = 0;
+      const char **glfwExtensions =
+          glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+      if (glfwExtensions == nullptr) {
+        throw std::runtime_error("GLFW can't create Vulkan surfaces.");
+      }
+      instanceExtensions.insert(instanceExtensions.end(), glfwExtensions,
+                                glfwExtensions + glfwExtensionCount);
+    }
     if (enableValidationLayers) {
       instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
@@ -107,36 +189,86 @@ void VulkanApp::createInstance() {
   }
 }
 
-void VulkanApp::setupDebugMessenger() {
+static ValidationLog::Severities
+validationSeverities(ValidationSeverity minimum) {
   using SeverityFlag = vk::DebugUtilsMessageSeverityFlagBitsEXT;
-  using MessageType = vk::DebugUtilsMessageTypeFlagBitsEXT;
+  ValidationLog::Severities severities = SeverityFlag::eError;
+  switch (minimum) {
+  case ValidationSeverity::Verbose:
+    severities |= SeverityFlag::eVerbose;
+    [[fallthrough]];
+  case ValidationSeverity::Info:
+    severities |= SeverityFlag::eInfo;
+    [[fallthrough]];
+  case ValidationSeverity::Warning:
+    severities |= SeverityFlag::eWarning;
+    break;
+  case ValidationSeverity::Error:
+    break;
+  }
+  return severities;
+}
+
+void VulkanApp::setupDebugMessenger() {
+  auto minimum = options.validationSeverity;
+  auto typeBits = options.validationTypes;
+  const bool watched = !options.validationConfig.empty();
+  if (watched) {
+    loadValidationConfig(options.validationConfig, minimum, typeBits);
+  }
+  validationLog = std::make_unique<ValidationLog>(
+      validationSeverities(minimum), ValidationLog::Types(typeBits),
+      options.validationRepeats);
 
-  auto callbackFunc =
-      reinterpret_cast<PFN_vkDebugUtilsMessengerCallbackEXT>(debugCallback);
+  // Only what gets printed is subscribed to: the layers build every message
+  // the messenger asks for, whether or not it is shown. A watched config may
+  // widen the filter later, so then everything is and the log filters.
   auto debugMessengerInfo =
       vk::DebugUtilsMessengerCreateInfoEXT()
-          .setMessageSeverity(SeverityFlag::eInfo | SeverityFlag::eVerbose |
-                              SeverityFlag::eWarning | SeverityFlag::eError)
-          .setMessageType(MessageType::eGeneral | MessageType::eValidation |
-                          MessageType::ePerformance)
-          .setPfnUserCallback(callbackFunc)
-          .setPUserData(nullptr);
+          .setMessageSeverity(
+              validationSeverities(watched ? ValidationSeverity::Verbose
+                                           : minimum))
+          .setMessageType(ValidationLog::Types(watched ? 7 : typeBits))
+          .setPfnUserCallback(&ValidationLog::callback)
+          .setPUserData(validationLog.get());
 
   vk::DynamicLoader dl;
   PFN_vkGetInstanceProcAddr GetInstanceProcAddr =
       dl.getProcAddress<PFN_vkGetInstanceProcAddr>("vkGetInstanceProcAddr");
-  vk::DispatchLoaderDynamic dispatch(instance, GetInstanceProcAddr);
-  if (instance.createDebugUtilsMessengerEXT(&debugMessengerInfo, 0,
-                                            &debugMessenger,
-                                            dispatch) != vk::Result::eSuccess) {
+  debugDispatch = vk::DispatchLoaderDynamic(instance, GetInstanceProcAddr);
+  if (instance.createDebugUtilsMessengerEXT(
+          &debugMessengerInfo, 0, &debugMessenger, debugDispatch) !=
+      vk::Result::eSuccess) {
     throw std::runtime_error("Create debug util messenger Failed");
   };
+  if (watched) {
+    validationWatcher = std::make_unique<ShaderWatcher>(
+        std::vector{options.validationConfig},
+        [this]() { reloadValidationFilter(); });
+  }
+}
+
+// Runs on the watcher thread.
+void VulkanApp::reloadValidationFilter() {
+  try {
+    auto minimum = options.validationSeverity;
+    auto typeBits = options.validationTypes;
+    loadValidationConfig(options.validationConfig, minimum, typeBits);
+    validationLog->setFilter(validationSeverities(minimum),
+                             ValidationLog::Types(typeBits));
+    std::cerr << "[validation] Filter reloaded\n";
+  } catch (const std::exception &e) {
+    std::cerr << std::format("[validation] {}\n", e.what());
+  }
 }
 
 void VulkanApp::createSurface() {
-  auto surfaceInfo =
-      vk::Win32SurfaceCreateInfoKHR().setHwnd(hwnd).setHinstance(hInstance);
-  surface = instance.createWin32SurfaceKHR(surfaceInfo);
+  VkSurfaceKHR rawSurface;
+  if (glfwCreateWindowSurface(static_cast<VkInstance>(instance), window,
+                              nullptr, &rawSurface) != VK_SUCCESS) {
+    throw std::runtime_error("Create window surface failed.");
+  }
+  surface = vk::SurfaceKHR(rawSurface);
 }
 
 void VulkanApp::pickPhysicalDevice() {
@@ -155,9 +287,13 @@ void VulkanApp::createLogicalDevice() {
   const auto supports =
       std::views::iota((std::size_t)0, queueFamilyProps.size()) |
       std::views::transform([this](auto i) {
+        bool graphics = static_cast<bool>(queueFamilyProps[i].queueFlags &
+                                          vk::QueueFlagBits::eGraphics);
+        if (options.headless) {
+          return graphics;
+        }
         auto support = gpu.getSurfaceSupportKHR(i, surface);
-        return support == VK_TRUE &&
-               queueFamilyProps[i].queueFlags & vk::QueueFlagBits::eGraphics;
+        return support == VK_TRUE && graphics;
       });
   const auto graphicProp = std::find(supports.begin(), supports.end(), true);
   bool found = graphicProp != supports.end();
@@ -170,21 +306,62 @@ void VulkanApp::createLogicalDevice() {
   auto feature = vk::PhysicalDeviceFeatures().setGeometryShader(VK_TRUE);
 
   float priorites[] = {0.0f};
-  deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  if (!options.headless) {
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  }
+  const auto available = gpu.enumerateDeviceExtensionProperties();
+  memoryBudget = std::any_of(
+      available.begin(), available.end(), [](const auto &extension) {
+        return std::string(extension.extensionName.data()) ==
+               VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+      });
+  if (memoryBudget) {
+    deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+
+  // Texture uploads prefer a transfer-only family (usually the DMA engines),
+  // then any non-graphics family with transfer, and share the graphics queue
+  // otherwise.
+  transferIndex = graphicIndex;
+  int transferScore = 0;
+  for (uint32_t i = 0; i < queueFamilyProps.size(); i++) {
+    auto flags = queueFamilyProps[i].queueFlags;
+    if (i == graphicIndex || !(flags & vk::QueueFlagBits::eTransfer) ||
+        (flags & vk::QueueFlagBits::eGraphics)) {
+      continue;
+    }
+    int score = (flags & vk::QueueFlagBits::eCompute) ? 1 : 2;
+    if (score > transferScore) {
+      transferIndex = i;
+      transferScore = score;
+    }
+  }
 
-  auto deviceQueueInfo = vk::DeviceQueueCreateInfo()
-                             .setQueueCount(1)
-                             .setPQueuePriorities(priorites)
-                             .setQueueFamilyIndex(graphicIndex);
+  std::vector<vk::DeviceQueueCreateInfo> deviceQueueInfos = {
+      vk::DeviceQueueCreateInfo()
+          .setQueueCount(1)
+          .setPQueuePriorities(priorites)
+          .setQueueFamilyIndex(graphicIndex)};
+  if (transferIndex != graphicIndex) {
+    deviceQueueInfos.push_back(vk::DeviceQueueCreateInfo()
+                                   .setQueueCount(1)
+                                   .setPQueuePriorities(priorites)
+                                   .setQueueFamilyIndex(transferIndex));
+  }
   auto deviceInfo = vk::DeviceCreateInfo()
-                        .setQueueCreateInfoCount(1)
-                        .setPQueueCreateInfos(&deviceQueueInfo)
+                        .setQueueCreateInfos(deviceQueueInfos)
                         .setEnabledExtensionCount(deviceExtensions.size())
                         .setPpEnabledExtensionNames(deviceExtensions.data())
                         .setPEnabledFeatures(&feature);
 
   device = gpu.createDevice(deviceInfo);
   graphicQueue = device.getQueue(graphicIndex, 0);
+  transferQueue = device.getQueue(transferIndex, 0);
+  allocator = std::make_shared<MemoryAllocator>(gpu, device);
+
+  if (options.headless) {
+    return;
+  }
 
   surfaceFormats = gpu.getSurfaceFormatsKHR(surface);
   if (surfaceFormats.empty()) {
@@ -199,30 +376,166 @@ void VulkanApp::createLogicalDevice() {
   surfaceCapabilities = gpu.getSurfaceCapabilitiesKHR(surface);
 }
 
+void VulkanApp::createPipelineCache() {
+  pipelineCache =
+      std::make_shared<PipelineCache>(gpu, device, options.pipelineCacheDir);
+  shaderModules = std::make_shared<ShaderModuleCache>(device);
+}
+
+static vk::PresentModeKHR toPresentMode(PresentMode mode) {
+  switch (mode) {
+  case PresentMode::FifoRelaxed:
+    return vk::PresentModeKHR::eFifoRelaxed;
+  case PresentMode::Mailbox:
+    return vk::PresentModeKHR::eMailbox;
+  case PresentMode::Immediate:
+    return vk::PresentModeKHR::eImmediate;
+  default:
+    return vk::PresentModeKHR::eFifo;
+  }
+}
+
 void VulkanApp::createSwapChain() {
-  format = surfaceFormats[0].format;
-  frameCount = surfaceCapabilities.minImageCount;
+  // ShaderToy writes display values straight into the framebuffer, so an
+  // UNORM target matches it; sRGB formats would encode them a second time.
+  auto surfaceFormat = std::find_if(
+      surfaceFormats.begin(), surfaceFormats.end(), [](const auto &candidate) {
+        return (candidate.format == vk::Format::eB8G8R8A8Unorm ||
+                candidate.format == vk::Format::eR8G8B8A8Unorm) &&
+               candidate.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
+      });
+  if (surfaceFormat == surfaceFormats.end()) {
+    surfaceFormat = surfaceFormats.begin();
+  }
+  format = surfaceFormat->format;
+
+  if (!swapchain) {
+    presentMode = toPresentMode(options.presentMode);
+    if (std::find(presentModes.begin(), presentModes.end(), presentMode) ==
+        presentModes.end()) {
+      std::cerr << std::format("[swapchain] {} is not supported, using FIFO\n",
+                               vk::to_string(presentMode));
+      presentMode = vk::PresentModeKHR::eFifo;
+    }
+  }
+
+  surfaceCapabilities = gpu.getSurfaceCapabilitiesKHR(surface);
+  auto extent = surfaceCapabilities.currentExtent;
+  if (extent.width == UINT32_MAX) {
+    // The surface takes its size from the swapchain.
+    int w, h;
+    glfwGetFramebufferSize(window, &w, &h);
+    extent.width = std::clamp(static_cast<uint32_t>(w),
+                              surfaceCapabilities.minImageExtent.width,
+                              surfaceCapabilities.maxImageExtent.width);
+    extent.height = std::clamp(static_cast<uint32_t>(h),
+                               surfaceCapabilities.minImageExtent.height,
+                               surfaceCapabilities.maxImageExtent.height);
+  }
+  width = extent.width, height = extent.height;
+
+  // One image more than the minimum lets the CPU record the next frame
+  // instead of waiting for the presentation engine to release one.
+  frameCount = options.swapchainImages ? options.swapchainImages
+                                       : surfaceCapabilities.minImageCount + 1;
+  frameCount = std::max(frameCount, surfaceCapabilities.minImageCount);
+  if (surfaceCapabilities.maxImageCount > 0) {
+    frameCount = std::min(frameCount, surfaceCapabilities.maxImageCount);
+  }
+
+  auto usage = vk::ImageUsageFlags(vk::ImageUsageFlagBits::eColorAttachment);
+  if (!options.exportPath.empty()) {
+    if (!(surfaceCapabilities.supportedUsageFlags &
+          vk::ImageUsageFlagBits::eTransferSrc)) {
+      throw std::runtime_error("Swapchain images can't be copied for export.");
+    }
+    usage |= vk::ImageUsageFlagBits::eTransferSrc;
+  }
+  if (options.computeImage) {
+    if (!(surfaceCapabilities.supportedUsageFlags &
+          vk::ImageUsageFlagBits::eTransferDst)) {
+      throw std::runtime_error("Swapchain images can't be blitted to.");
+    }
+    usage |= vk::ImageUsageFlagBits::eTransferDst;
+  }
 
   auto swapchainInfo =
       vk::SwapchainCreateInfoKHR()
           .setSurface(surface)
           .setImageFormat(format)
           .setMinImageCount(frameCount)
-          .setImageExtent(vk::Extent2D(width, height))
-          .setPresentMode(vk::PresentModeKHR::eFifo)
+          .setImageExtent(extent)
+          .setPresentMode(presentMode)
           .setImageSharingMode(vk::SharingMode::eExclusive)
           .setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque)
-          .setImageColorSpace(surfaceFormats[0].colorSpace)
-          .setImageUsage(vk::ImageUsageFlagBits::eColorAttachment)
+          .setImageColorSpace(surfaceFormat->colorSpace)
+          .setImageUsage(usage)
           .setImageArrayLayers(1)
-          .setClipped(true);
+          .setClipped(true)
+          .setPreTransform(surfaceCapabilities.currentTransform)
+          .setOldSwapchain(swapchain);
 
+  auto old = swapchain;
   swapchain = device.createSwapchainKHR(swapchainInfo);
+  device.destroySwapchainKHR(old);
+  swapchainImages = device.getSwapchainImagesKHR(swapchain);
+  frameCount = swapchainImages.size();
+}
+
+void VulkanApp::createOffscreenTargets() {
+  format = vk::Format::eR8G8B8A8Unorm;
+  // One target per frame slot: a slot's fence also guards its target.
+  frameCount = options.framesInFlight;
+
+  swapchainImages.resize(frameCount);
+  offscreenMemory.resize(frameCount);
+  for (uint32_t i = 0; i < frameCount; i++) {
+    auto imageInfo =
+        vk::ImageCreateInfo()
+            .setImageType(vk::ImageType::e2D)
+            .setFormat(format)
+            .setExtent(vk::Extent3D(width, height, 1))
+            .setMipLevels(1)
+            .setArrayLayers(1)
+            .setSamples(vk::SampleCountFlagBits::e1)
+            .setTiling(vk::ImageTiling::eOptimal)
+            .setUsage(vk::ImageUsageFlagBits::eColorAttachment |
+                      vk::ImageUsageFlagBits::eTransferSrc |
+                      vk::ImageUsageFlagBits::eTransferDst)
+            .setSharingMode(vk::SharingMode::eExclusive)
+            .setInitialLayout(vk::ImageLayout::eUndefined);
+    swapchainImages[i] = device.createImage(imageInfo);
+
+    offscreenMemory[i] = allocator->allocateImage(
+        swapchainImages[i], vk::MemoryPropertyFlagBits::eDeviceLocal);
+  }
+}
+
+std::optional<uint64_t> VulkanApp::deviceMemoryUsage() const {
+  if (!memoryBudget) {
+    return std::nullopt;
+  }
+  auto chain =
+      gpu.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2,
+                               vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+  const auto &properties =
+      chain.get<vk::PhysicalDeviceMemoryProperties2>().memoryProperties;
+  const auto &budget = chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+  uint64_t usage = 0;
+  for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+    if (properties.memoryHeaps[i].flags &
+        vk::MemoryHeapFlagBits::eDeviceLocal) {
+      usage += budget.heapUsage[i];
+    }
+  }
+  return usage;
+}
+
+vk::PhysicalDeviceProperties VulkanApp::deviceProperties() const {
+  return gpu.getProperties();
 }
 
 void VulkanApp::createImageView() {
-  swapchainImages = device.getSwapchainImagesKHR(swapchain);
-  frameCount = swapchainImages.size();
 
   swapchainIamgesViews.resize(frameCount);
   for (uint32_t i = 0; i < frameCount; i++) {
@@ -252,7 +565,9 @@ void VulkanApp::createRenderPass() {
           .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
           .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
           .setInitialLayout(vk::ImageLayout::eUndefined)
-          .setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+          .setFinalLayout(options.headless
+                              ? vk::ImageLayout::eTransferSrcOptimal
+                              : vk::ImageLayout::ePresentSrcKHR);
 
   auto colorAttachmentRef =
       vk::AttachmentReference{}.setAttachment(0).setLayout(
@@ -262,39 +577,438 @@ void VulkanApp::createRenderPass() {
                      .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
                      .setColorAttachmentCount(1)
                      .setPColorAttachments(&colorAttachmentRef);
+  using Stage = vk::PipelineStageFlagBits;
+  std::array<vk::SubpassDependency, 2> dependencies = {
+      // Chains the initial layout transition to the imageAvailable wait, so
+      // the image isn't written while presentation still reads it.
+      vk::SubpassDependency()
+          .setSrcSubpass(VK_SUBPASS_EXTERNAL)
+          .setDstSubpass(0)
+          .setSrcStageMask(Stage::eColorAttachmentOutput)
+          .setDstStageMask(Stage::eColorAttachmentOutput)
+          .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite),
+      // Orders the final layout transition before a frame export copy.
+      vk::SubpassDependency()
+          .setSrcSubpass(0)
+          .setDstSubpass(VK_SUBPASS_EXTERNAL)
+          .setSrcStageMask(Stage::eColorAttachmentOutput)
+          .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+          .setDstStageMask(Stage::eTransfer)
+          .setDstAccessMask(vk::AccessFlagBits::eTransferRead)};
   auto renderPassInfo = vk::RenderPassCreateInfo()
                             .setAttachmentCount(1)
                             .setPAttachments(&colorAttachment)
                             .setSubpassCount(1)
-                            .setPSubpasses(&subpass);
+                            .setPSubpasses(&subpass)
+                            .setDependencies(dependencies);
   renderPass = device.createRenderPass(renderPassInfo);
 }
+void VulkanApp::createDescriptorSetLayout() {
+  // iChannel0-3.
+  std::array<vk::DescriptorSetLayoutBinding, 4> bindings;
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    bindings[i] = vk::DescriptorSetLayoutBinding()
+                      .setBinding(i)
+                      .setDescriptorType(
+                          vk::DescriptorType::eCombinedImageSampler)
+                      .setDescriptorCount(1)
+                      .setStageFlags(vk::ShaderStageFlagBits::eFragment |
+                                     vk::ShaderStageFlagBits::eCompute);
+  }
+  descriptorSetLayout = device.createDescriptorSetLayout(
+      vk::DescriptorSetLayoutCreateInfo().setBindings(bindings));
+
+  // Output of compute passes.
+  auto storageBinding =
+      vk::DescriptorSetLayoutBinding()
+          .setBinding(0)
+          .setDescriptorType(vk::DescriptorType::eStorageImage)
+          .setDescriptorCount(1)
+          .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+  storageSetLayout = device.createDescriptorSetLayout(
+      vk::DescriptorSetLayoutCreateInfo().setBindings(storageBinding));
+}
+
+void VulkanApp::createShaderInputs() {
+  const auto limits = gpu.getProperties().limits;
+  if (sizeof(ShaderInputs) <= limits.maxPushConstantsSize) {
+    return;
+  }
+  shaderCompiler.setInputRing(true);
+
+  const auto alignment = limits.minUniformBufferOffsetAlignment;
+  inputRing.stride =
+      (sizeof(ShaderInputs) + alignment - 1) / alignment * alignment;
+  inputRing.buffer = device.createBuffer(
+      vk::BufferCreateInfo()
+          .setSize(inputRing.stride * options.framesInFlight * 2)
+          .setUsage(vk::BufferUsageFlagBits::eUniformBuffer)
+          .setSharingMode(vk::SharingMode::eExclusive));
+  inputRing.memory = allocator->allocateBuffer(
+      inputRing.buffer, vk::MemoryPropertyFlagBits::eHostVisible |
+                            vk::MemoryPropertyFlagBits::eHostCoherent);
+  inputRing.data = inputRing.memory.data;
+
+  auto binding =
+      vk::DescriptorSetLayoutBinding()
+          .setBinding(0)
+          .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+          .setDescriptorCount(1)
+          .setStageFlags(vk::ShaderStageFlagBits::eFragment |
+                         vk::ShaderStageFlagBits::eCompute);
+  inputRing.setLayout = device.createDescriptorSetLayout(
+      vk::DescriptorSetLayoutCreateInfo().setBindings(binding));
+  auto poolSize =
+      vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1);
+  inputRing.pool = device.createDescriptorPool(
+      vk::DescriptorPoolCreateInfo().setMaxSets(1).setPoolSizes(poolSize));
+  inputRing.set = device
+                      .allocateDescriptorSets(
+                          vk::DescriptorSetAllocateInfo()
+                              .setDescriptorPool(inputRing.pool)
+                              .setSetLayouts(inputRing.setLayout))
+                      .front();
+  auto bufferInfo =
+      vk::DescriptorBufferInfo(inputRing.buffer, 0, sizeof(ShaderInputs));
+  device.updateDescriptorSets(
+      vk::WriteDescriptorSet()
+          .setDstSet(inputRing.set)
+          .setDstBinding(0)
+          .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+          .setBufferInfo(bufferInfo),
+      nullptr);
+}
+
+// The built-in passes of accumulation mode. Both address texels directly,
+// so they keep whatever orientation the Image pass rendered in.
+static const char *accumulateSource = R"(
+void mainImage(out vec4 sum, in vec2 fragCoord) {
+  ivec2 texel = ivec2(gl_FragCoord.xy);
+  vec3 color = texelFetch(iChannel0, texel, 0).rgb;
+  // One bad sample would otherwise spoil the pixel for good.
+  if (any(isnan(color)) || any(isinf(color))) {
+    color = vec3(0.0);
+  }
+  float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+  sum = vec4(color, luminance * luminance);
+  if (iSample > 0) {
+    sum += texelFetch(iChannel1, texel, 0);
+  }
+}
+)";
+
+static const char *resolveSource = R"(
+void mainImage(out vec4 color, in vec2 fragCoord) {
+  vec4 sum = texelFetch(iChannel0, ivec2(gl_FragCoord.xy), 0);
+  color = vec4(sum.rgb / float(iSample + 1), 1.0);
+}
+)";
+
+static int bufferIndex(const std::string &name) {
+  if (name.size() == 1 && name[0] >= 'a' && name[0] <= 'd') {
+    return name[0] - 'a';
+  }
+  return -1;
+}
+
+void VulkanApp::createRenderGraph() {
+  static const char *bufferNames[] = {"Buffer A", "Buffer B", "Buffer C",
+                                      "Buffer D"};
+  // Half floats are guaranteed to be renderable and linearly filterable,
+  // and cost half the bandwidth of ShaderToy's fp32 buffers.
+  const auto bufferFormat = vk::Format::eR16G16B16A16Sfloat;
+
+  std::array<RenderGraph::ImageId, 4> bufferImages;
+  bufferImages.fill(RenderGraph::noImage);
+  for (std::size_t i = 0; i < options.buffers.size(); i++) {
+    if (!options.buffers[i].shader.empty()) {
+      bufferImages[i] = renderGraph.addImage(bufferNames[i], bufferFormat);
+    }
+  }
+
+  // Textures are requested once per path and type, and start out as the
+  // loader's placeholder.
+  std::map<std::pair<std::string, vk::ImageViewType>, RenderGraph::ImageId>
+      textureByPath;
+  const auto textureRead = [&](const std::string &path,
+                               vk::ImageViewType type) {
+    auto [entry, added] =
+        textureByPath.try_emplace({path, type}, RenderGraph::noImage);
+    if (added) {
+      auto id = textures->request(path, type);
+      entry->second = renderGraph.addExternalImage(path, textures->view(id),
+                                                   textures->sampler());
+      textureImages.resize(id + 1, RenderGraph::noImage);
+      textureImages[id] = entry->second;
+    }
+    return entry->second;
+  };
+  const auto channelReads = [&](const std::array<std::string, 4> &channels,
+                                ChannelTypes &types) {
+    std::vector<RenderGraph::ImageId> reads;
+    types = defaultChannelTypes;
+    for (std::size_t i = 0; i < channels.size(); i++) {
+      const auto &channel = channels[i];
+      if (channel.empty()) {
+        reads.push_back(RenderGraph::noImage);
+      } else if (channel.starts_with("cube:")) {
+        types[i] = vk::ImageViewType::eCube;
+        reads.push_back(textureRead(channel.substr(5), types[i]));
+      } else if (channel.starts_with("volume:")) {
+        types[i] = vk::ImageViewType::e3D;
+        reads.push_back(textureRead(channel.substr(7), types[i]));
+      } else if (int index = bufferIndex(channel); index >= 0) {
+        if (bufferImages[index] == RenderGraph::noImage) {
+          throw std::runtime_error(
+              std::format("Channel source {} is not a buffer pass.", channel));
+        }
+        reads.push_back(bufferImages[index]);
+      } else {
+        reads.push_back(textureRead(channel, vk::ImageViewType::e2D));
+      }
+    }
+    return reads;
+  };
+
+  for (std::size_t i = 0; i < options.buffers.size(); i++) {
+    const auto &buffer = options.buffers[i];
+    if (buffer.shader.empty()) {
+      continue;
+    }
+    ChannelTypes types;
+    auto reads = channelReads(buffer.channels, types);
+    passes.push_back(ShaderPass{
+        .name = bufferNames[i],
+        .shader = buffer.shader,
+        .graphPass = renderGraph.addPass(bufferNames[i], reads,
+                                         bufferImages[i], buffer.compute),
+        .format = bufferFormat,
+        .compute = buffer.compute,
+        .channels = types});
+  }
+
+  ChannelTypes imageTypes;
+  auto imageReads = channelReads(options.channels, imageTypes);
+  if (!options.computeImage && !resolutionScaler && !options.accumulate) {
+    passes.push_back(ShaderPass{
+        .name = "Image",
+        .shader = options.fragmentShader,
+        .graphPass = renderGraph.addPass("Image", imageReads, std::nullopt),
+        .format = format,
+        .output = true,
+        .channels = imageTypes});
+  } else {
+    // Swapchain images rarely support storage, and a scaled Image pass
+    // renders into part of a full-size image, so either writes a graph image
+    // that is blitted over at the end of the frame. An accumulated one is
+    // resolved into the target instead.
+    if (!(gpu.getFormatProperties(format).optimalTilingFeatures &
+          vk::FormatFeatureFlagBits::eBlitDst)) {
+      throw std::runtime_error("Target format can't be blitted to.");
+    }
+    outputImage = renderGraph.addImage("Image", bufferFormat);
+    passes.push_back(ShaderPass{
+        .name = "Image",
+        .shader = options.fragmentShader,
+        .graphPass = renderGraph.addPass("Image", imageReads, outputImage,
+                                         options.computeImage),
+        .format = bufferFormat,
+        .compute = options.computeImage,
+        .output = true,
+        .channels = imageTypes});
+  }
+
+  if (options.accumulate) {
+    // An fp16 sum would stop growing long before the samples run out.
+    const auto sumFormat = vk::Format::eR32G32B32A32Sfloat;
+    accumulationImage = renderGraph.addImage("Accumulation", sumFormat);
+    passes.push_back(ShaderPass{
+        .name = "Accumulate",
+        .source = accumulateSource,
+        .graphPass = renderGraph.addPass("Accumulate",
+                                         {outputImage, accumulationImage},
+                                         accumulationImage),
+        .format = sumFormat});
+    passes.push_back(ShaderPass{
+        .name = "Resolve",
+        .source = resolveSource,
+        .graphPass =
+            renderGraph.addPass("Resolve", {accumulationImage}, std::nullopt),
+        .format = format});
+  }
+
+  compileRenderGraph();
+}
+
+void VulkanApp::compileRenderGraph() {
+  auto context = RenderGraph::Context{
+      .device = device,
+      .descriptorSetLayout = descriptorSetLayout,
+      .storageSetLayout = storageSetLayout,
+      .allocator = allocator.get(),
+      .frameSlots = options.framesInFlight};
+  renderGraph.compile(context, vk::Extent2D(width, height));
+}
+
+vk::RenderPass VulkanApp::passRenderPass(const ShaderPass &pass) const {
+  auto graphPass = renderGraph.renderPass(pass.graphPass);
+  return graphPass ? graphPass : renderPass;
+}
+
 void VulkanApp::createGraphicPipline() {
-  auto vertexShader = createShaderModule("Shaders\\vertex.spv", device);
-  auto fragmentShader = createShaderModule("Shaders\\fragement.spv", device);
+  // The ShaderToy inputs come right after the sets each kind of pass uses.
+  std::vector<vk::DescriptorSetLayout> setLayouts = {descriptorSetLayout};
+  std::vector<vk::DescriptorSetLayout> computeSetLayouts = {
+      descriptorSetLayout, storageSetLayout};
+  auto range = vk::PushConstantRange()
+                   .setOffset(0)
+                   .setSize(sizeof(ShaderInputs))
+                   .setStageFlags(vk::ShaderStageFlagBits::eAll);
+  auto plInfo = vk::PipelineLayoutCreateInfo();
+  auto computePlInfo = vk::PipelineLayoutCreateInfo();
+  if (inputRing.buffer) {
+    setLayouts.push_back(inputRing.setLayout);
+    computeSetLayouts.push_back(inputRing.setLayout);
+  } else {
+    plInfo.setPushConstantRanges(range);
+    computePlInfo.setPushConstantRanges(range);
+  }
+  plInfo.setSetLayouts(setLayouts);
+  computePlInfo.setSetLayouts(computeSetLayouts);
+
+  pipelineLayout = device.createPipelineLayout(plInfo);
+  computePipelineLayout = device.createPipelineLayout(computePlInfo);
+
+  auto vertexCode = shaderCompiler.load(options.vertexShader,
+                                        vk::ShaderStageFlagBits::eVertex);
+  const auto values = specValues();
+  InputUse use = reflectInputs(vertexCode.code());
+  for (auto &pass : passes) {
+    pass.pipeline = buildPassPipeline(vertexCode, pass, values, use);
+  }
+  inputUse = use;
+}
+
+static bool isTimeInput(const std::string &name) {
+  return name == "iTime" || name == "iTimeDelta" || name == "iFrameRate" ||
+         name == "iFrame" || name == "iDate" || name == "iSample";
+}
+
+VulkanApp::InputUse VulkanApp::reflectInputs(std::span<const uint32_t> code) {
+  auto members = spirvBlockMembersRead(code);
+  if (!members) {
+    return {.time = true, .mouse = true};
+  }
+  return {.time = std::ranges::any_of(*members, isTimeInput),
+          .mouse = members->contains("iMouse")};
+}
+
+SpecValues VulkanApp::specValues() const {
+  SpecValues values;
+  if (!options.specConfig.empty()) {
+    values = loadSpecConfig(options.specConfig, options.qualityTier);
+  }
+  for (const auto &[name, value] : options.specValues) {
+    values[name] = value;
+  }
+  return values;
+}
+
+vk::Pipeline VulkanApp::buildPassPipeline(const ShaderCode &vertexCode,
+                                          const ShaderPass &pass,
+                                          const SpecValues &values,
+                                          InputUse &use) {
+  const auto load = [&](vk::ShaderStageFlagBits stage) {
+    if (!pass.source) {
+      return shaderCompiler.load(pass.shader, stage, pass.channels,
+                                 pass.output);
+    }
+    ShaderCode code;
+    code.words = shaderCompiler.compileSource(pass.source, pass.name, stage,
+                                              pass.channels, pass.output);
+    return code;
+  };
+  const auto addUse = [&](std::span<const uint32_t> code) {
+    const auto reads = reflectInputs(code);
+    use.time |= reads.time;
+    use.mouse |= reads.mouse;
+  };
+  if (pass.compute) {
+    auto code = load(vk::ShaderStageFlagBits::eCompute);
+    addUse(code.code());
+    return buildComputePipeline(code.code(), pass, values);
+  }
+  auto fragmentCode = load(vk::ShaderStageFlagBits::eFragment);
+  addUse(fragmentCode.code());
+  return buildGraphicPipeline(vertexCode.code(), fragmentCode.code(), pass,
+                              values);
+}
+
+vk::ShaderModule VulkanApp::shaderModule(uint64_t hash,
+                                         std::span<const uint32_t> code) {
+  auto module = shaderModules->acquire(hash, code);
+  std::lock_guard lock(moduleMutex);
+  if (!acquiredModules.insert(hash).second) {
+    // This app already holds it.
+    shaderModules->release(hash);
+  }
+  return module;
+}
+
+vk::Pipeline VulkanApp::pipelineVariant(
+    uint64_t key, uint64_t shaderHash,
+    const std::function<vk::Pipeline(vk::PipelineCache)> &create) {
+  {
+    std::lock_guard lock(variantMutex);
+    if (auto it = pipelineVariants.find(key); it != pipelineVariants.end()) {
+      return it->second.pipeline;
+    }
+  }
+  // Built unlocked so the render thread never waits on a compile.
+  const auto cache = pipelineCache->get(key);
+  const auto start = std::chrono::steady_clock::now();
+  auto pipeline = create(cache);
+  const auto end = std::chrono::steady_clock::now();
+  std::lock_guard lock(variantMutex);
+  pipelineMs += std::chrono::duration<double, std::milli>(end - start).count();
+  auto [it, inserted] =
+      pipelineVariants.try_emplace(key, PipelineVariant{pipeline, shaderHash});
+  if (!inserted) {
+    // Another thread built the same variant meanwhile.
+    device.destroyPipeline(pipeline);
+  }
+  return it->second.pipeline;
+}
+
+// Safe to call from any thread once the render pass and layout exist.
+vk::Pipeline
+VulkanApp::buildGraphicPipeline(std::span<const uint32_t> vertexCode,
+                                std::span<const uint32_t> fragmentCode,
+                                const ShaderPass &pass,
+                                const SpecValues &values) {
+  const auto vertexHash = hashSpirv(vertexCode);
+  const auto fragmentHash = hashSpirv(fragmentCode);
+  auto vertexShader = shaderModule(vertexHash, vertexCode);
+  auto fragmentShader = shaderModule(fragmentHash, fragmentCode);
+  Specialization vertexSpec(vertexCode, values);
+  Specialization fragmentSpec(fragmentCode, values);
+  const auto vertexSpecInfo = vertexSpec.info();
+  const auto fragmentSpecInfo = fragmentSpec.info();
 
   using ShaderStage = vk::ShaderStageFlagBits;
 
   auto vertexShaderCreateInfo = vk::PipelineShaderStageCreateInfo()
                                     .setPName("main")
                                     .setModule(vertexShader)
-                                    .setStage(ShaderStage::eVertex);
-
-  /*
-    auto SMEData =
-        vk::SpecializationMapEntry().setConstantID(0).setOffset(0).setSize(
-            sizeof(vk::Format));
-    auto specializationInfo = vk::SpecializationInfo()
-                                  .setDataSize(sizeof(vk::Format))
-                                  .setMapEntryCount(1)
-                                  .setPMapEntries(&SMEData)
-                                  .setPData(&data);
-                                  */
-
-  auto fragmentShaderCreateInfo = vk::PipelineShaderStageCreateInfo()
-                                      .setPName("main")
-                                      .setModule(fragmentShader)
-                                      .setStage(ShaderStage::eFragment);
+                                    .setStage(ShaderStage::eVertex)
+                                    .setPSpecializationInfo(&vertexSpecInfo);
+
+  auto fragmentShaderCreateInfo =
+      vk::PipelineShaderStageCreateInfo()
+          .setPName("main")
+          .setModule(fragmentShader)
+          .setStage(ShaderStage::eFragment)
+          .setPSpecializationInfo(&fragmentSpecInfo);
 
   std::vector<vk::PipelineShaderStageCreateInfo> pipelineShaderInfo{
       vertexShaderCreateInfo, fragmentShaderCreateInfo};
@@ -315,7 +1029,7 @@ void VulkanApp::createGraphicPipline() {
                     .setTopology(vk::PrimitiveTopology::eTriangleList)
                     .setPrimitiveRestartEnable(VK_FALSE);
   auto rsInfo = vk::PipelineRasterizationStateCreateInfo()
-                    .setCullMode(vk::CullModeFlagBits::eBack)
+                    .setCullMode(vk::CullModeFlagBits::eNone)
                     .setDepthBiasEnable(VK_FALSE)
                     .setDepthClampEnable(VK_FALSE)
                     .setFrontFace(vk::FrontFace::eClockwise)
@@ -339,17 +1053,19 @@ void VulkanApp::createGraphicPipline() {
                     .setViewportCount(1)
                     .setPViewports(&viewport);
   auto dsInfo = vk::PipelineDepthStencilStateCreateInfo()
-                    .setDepthTestEnable(VK_TRUE)
-                    .setDepthWriteEnable(VK_TRUE)
+                    .setDepthTestEnable(VK_FALSE)
+                    .setDepthWriteEnable(VK_FALSE)
                     .setDepthCompareOp(vk::CompareOp::eLess)
                     .setDepthBoundsTestEnable(VK_FALSE)
                     .setStencilTestEnable(VK_FALSE);
+  // Every pass overwrites its target, and buffer alpha is plain data, so
+  // neither blending nor alpha-to-coverage may touch it.
   auto attState =
       vk::PipelineColorBlendAttachmentState()
           .setColorWriteMask(
               vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
               vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA)
-          .setBlendEnable(VK_TRUE)
+          .setBlendEnable(VK_FALSE)
           .setColorBlendOp(vk::BlendOp::eAdd)
           .setSrcColorBlendFactor(vk::BlendFactor::eSrc1Alpha)
           .setDstAlphaBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
@@ -362,21 +1078,11 @@ void VulkanApp::createGraphicPipline() {
                     .setPAttachments(&attState)
                     .setLogicOp(vk::LogicOp::eNoOp);
   auto msInfo = vk::PipelineMultisampleStateCreateInfo()
-                    .setAlphaToCoverageEnable(VK_TRUE)
+                    .setAlphaToCoverageEnable(VK_FALSE)
                     .setAlphaToOneEnable(VK_FALSE)
                     .setMinSampleShading(1.0f)
                     .setRasterizationSamples(vk::SampleCountFlagBits::e1)
-                    .setSampleShadingEnable(VK_TRUE);
-  auto range = vk::PushConstantRange()
-                   .setOffset(0)
-                   //.setSize(dataSize)
-                   .setStageFlags(vk::ShaderStageFlagBits::eAll);
-  auto plInfo = vk::PipelineLayoutCreateInfo()
-                    .setPushConstantRangeCount(1)
-                    .setPPushConstantRanges(&range);
-
-  pipelineLayout = device.createPipelineLayout(plInfo);
-
+                    .setSampleShadingEnable(VK_FALSE);
   auto pipelineInfo = vk::GraphicsPipelineCreateInfo()
                           .setStages(pipelineShaderInfo)
                           .setPVertexInputState(&viInfo)
@@ -388,14 +1094,70 @@ void VulkanApp::createGraphicPipline() {
                           .setPColorBlendState(&cbInfo)
                           .setPDynamicState(&dynamicInfo)
                           .setLayout(pipelineLayout)
-                          .setRenderPass(renderPass)
+                          .setRenderPass(passRenderPass(pass))
                           .setSubpass(0);
-  if (auto p = device.createGraphicsPipeline(nullptr, pipelineInfo);
-      p.result == vk::Result::eSuccess) {
-    pipeline = p.value;
-  } else {
-    throw std::runtime_error("Create graphic pipline failed.");
+  // Bump when the fixed-function state above changes, so old cache blobs for
+  // the same SPIR-V are not picked up.
+  const uint64_t pipelineStateVersion = 4;
+  auto pipelineKey = hashCombine(vertexHash, fragmentHash);
+  pipelineKey = hashCombine(pipelineKey, static_cast<uint64_t>(pass.format));
+  pipelineKey = hashCombine(pipelineKey, vertexSpec.hash());
+  pipelineKey = hashCombine(pipelineKey, fragmentSpec.hash());
+  pipelineKey = hashCombine(pipelineKey, pipelineStateVersion);
+
+  return pipelineVariant(
+      pipelineKey, hashCombine(vertexHash, fragmentHash),
+      [&](vk::PipelineCache cache) {
+        auto p = device.createGraphicsPipeline(cache, pipelineInfo);
+        if (p.result != vk::Result::eSuccess) {
+          throw std::runtime_error("Create graphic pipline failed.");
+        }
+        return p.value;
+      });
+}
+
+vk::Pipeline VulkanApp::buildComputePipeline(std::span<const uint32_t> code,
+                                             const ShaderPass &pass,
+                                             const SpecValues &values) {
+  const auto limits = gpu.getProperties().limits;
+  const std::array<uint32_t, 2> workgroup = {options.workgroupWidth,
+                                             options.workgroupHeight};
+  if (workgroup[0] > limits.maxComputeWorkGroupSize[0] ||
+      workgroup[1] > limits.maxComputeWorkGroupSize[1] ||
+      workgroup[0] * workgroup[1] > limits.maxComputeWorkGroupInvocations) {
+    throw std::runtime_error(std::format("Workgroup {}x{} exceeds the device "
+                                         "limits.",
+                                         workgroup[0], workgroup[1]));
   }
+
+  const auto hash = hashSpirv(code);
+  auto shader = shaderModule(hash, code);
+
+  // constant_id 0 and 1 are the workgroup size of the compute wrapper.
+  Specialization spec(code, values);
+  spec.set(0, workgroup[0]);
+  spec.set(1, workgroup[1]);
+  const auto specializationInfo = spec.info();
+  auto stageInfo = vk::PipelineShaderStageCreateInfo()
+                       .setPName("main")
+                       .setModule(shader)
+                       .setStage(vk::ShaderStageFlagBits::eCompute)
+                       .setPSpecializationInfo(&specializationInfo);
+  auto pipelineInfo = vk::ComputePipelineCreateInfo()
+                          .setStage(stageInfo)
+                          .setLayout(computePipelineLayout);
+
+  const uint64_t computeStateVersion = 3;
+  auto pipelineKey = hashCombine(hash, spec.hash());
+  pipelineKey = hashCombine(pipelineKey, computeStateVersion);
+
+  return pipelineVariant(pipelineKey, hash, [&](vk::PipelineCache cache) {
+    auto p = device.createComputePipeline(cache, pipelineInfo);
+    if (p.result != vk::Result::eSuccess) {
+      throw std::runtime_error("Create compute pipline failed.");
+    }
+    return p.value;
+  });
 }
 
 void VulkanApp::createFrambuffers() {
@@ -414,43 +1176,887 @@ void VulkanApp::createFrambuffers() {
   }
 }
 
+void VulkanApp::createCommandBuffers() {
+  auto poolInfo =
+      vk::CommandPoolCreateInfo()
+          .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer)
+          .setQueueFamilyIndex(graphicIndex);
+  commandPool = device.createCommandPool(poolInfo);
+
+  frames.resize(options.framesInFlight);
+  auto allocInfo = vk::CommandBufferAllocateInfo()
+                       .setCommandPool(commandPool)
+                       .setLevel(vk::CommandBufferLevel::ePrimary)
+                       .setCommandBufferCount(frames.size());
+  auto commandBuffers = device.allocateCommandBuffers(allocInfo);
+  for (std::size_t i = 0; i < frames.size(); i++) {
+    frames[i].commandBuffer = commandBuffers[i];
+  }
+}
+
+void VulkanApp::createSyncObjects() {
+  for (auto &frame : frames) {
+    frame.imageAvailable = device.createSemaphore(vk::SemaphoreCreateInfo());
+    frame.inFlight = device.createFence(
+        vk::FenceCreateInfo().setFlags(vk::FenceCreateFlagBits::eSignaled));
+  }
+  createImageSyncObjects();
+}
+
+void VulkanApp::createImageSyncObjects() {
+  // Present may still be reading a render-finished semaphore when its frame
+  // slot comes round again, so these belong to the swapchain image instead.
+  renderFinished.resize(frameCount);
+  for (auto &semaphore : renderFinished) {
+    semaphore = device.createSemaphore(vk::SemaphoreCreateInfo());
+  }
+  imagesInFlight.assign(frameCount, nullptr);
+}
+
+void VulkanApp::createFrameExporter() {
+  auto context = FrameExporter::Context{.device = device,
+                                        .allocator = allocator.get()};
+  auto ringSize = options.exportRing ? options.exportRing
+                                     : options.framesInFlight + 2;
+  auto threads = options.exportThreads
+                     ? options.exportThreads
+                     : std::max(std::thread::hardware_concurrency(), 2u) - 1;
+  auto imageExtent = options.tileSize
+                         ? vk::Extent2D(options.width, options.height)
+                         : vk::Extent2D();
+  exporter = std::make_unique<FrameExporter>(
+      context, vk::Extent2D(width, height), format, options.exportPath,
+      ringSize, threads, options.exportFps, imageExtent);
+}
+
+void VulkanApp::createAccumulator() {
+  accumulator.emplace(Accumulator::Context{.device = device,
+                                           .allocator = allocator.get()},
+                      vk::Extent2D(width, height), options.maxSamples,
+                      options.noiseThreshold);
+}
+
+void VulkanApp::createTextureLoader() {
+  auto context = TextureLoader::Context{
+      .gpu = gpu,
+      .device = device,
+      .graphicsQueue = graphicQueue,
+      .graphicsFamily = graphicIndex,
+      .transferQueue = transferQueue,
+      .transferFamily = transferIndex,
+      .allocator = allocator.get(),
+      .queueMutex = queueMutex.get()};
+  const vk::DeviceSize stagingSize = 64ull << 20;
+  auto threads = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+  textures = std::make_unique<TextureLoader>(context, stagingSize, threads);
+}
+
+void VulkanApp::recordCommandBuffer(vk::CommandBuffer commandBuffer,
+                                    uint32_t imageIndex) {
+  commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+  auto renderArea = vk::Rect2D(vk::Offset2D(0, 0), vk::Extent2D(width, height));
+  commandBuffer.setViewport(
+      0, vk::Viewport(0.0f, 0.0f, static_cast<float>(width),
+                      static_cast<float>(height), 0.0f, 1.0f));
+  commandBuffer.setScissor(0, renderArea);
+  const float blendConstants[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  commandBuffer.setBlendConstants(blendConstants);
+
+  profiler.beginFrame(commandBuffer, currentFrame, frameNumber);
+  profiler.beginGpuScope(commandBuffer, currentFrame, "frame");
+  renderGraph.beginFrame(commandBuffer, currentFrame);
+  for (const auto &pass : passes) {
+    profiler.beginGpuScope(commandBuffer, currentFrame, pass.name);
+    const bool output = pass.output;
+    const bool last = &pass == &passes.back();
+    // Only the Image pass is scaled: buffers are sampled by normalized
+    // coordinates and fed back, so they keep the full size.
+    const auto extent = output ? outputExtent : vk::Extent2D(width, height);
+    if (output && !pass.compute) {
+      renderGraph.setRenderArea(pass.graphPass, extent);
+      commandBuffer.setViewport(
+          0, vk::Viewport(0.0f, 0.0f, static_cast<float>(extent.width),
+                          static_cast<float>(extent.height), 0.0f, 1.0f));
+      commandBuffer.setScissor(0, vk::Rect2D(vk::Offset2D(0, 0), extent));
+    }
+    renderGraph.beginPass(commandBuffer, pass.graphPass, frameNumber);
+
+    if (pass.compute) {
+      const std::array sets = {
+          renderGraph.descriptorSet(pass.graphPass, currentFrame,
+                                    frameNumber),
+          renderGraph.storageSet(pass.graphPass, frameNumber)};
+      commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+                                 pass.pipeline);
+      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                       computePipelineLayout, 0, sets,
+                                       nullptr);
+      bindShaderInputs(commandBuffer, vk::PipelineBindPoint::eCompute,
+                       computePipelineLayout, 2, output);
+      commandBuffer.dispatch(
+          (extent.width + options.workgroupWidth - 1) / options.workgroupWidth,
+          (extent.height + options.workgroupHeight - 1) /
+              options.workgroupHeight,
+          1);
+      renderGraph.endPass(commandBuffer, pass.graphPass);
+      if (last) {
+        blitOutput(commandBuffer, imageIndex);
+      }
+      profiler.endGpuScope(commandBuffer, currentFrame);
+      continue;
+    }
+
+    // Unless it is scaled, the last pass draws straight into the swapchain
+    // (or offscreen) target.
+    const bool direct = last && !renderGraph.renderPass(pass.graphPass);
+    if (direct) {
+      vk::ClearValue clearValue(
+          vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f}));
+      auto renderPassInfo =
+          vk::RenderPassBeginInfo()
+              .setRenderPass(renderPass)
+              .setFramebuffer(swapChainFramebuffers[imageIndex])
+              .setRenderArea(renderArea)
+              .setClearValues(clearValue);
+      commandBuffer.beginRenderPass(renderPassInfo,
+                                    vk::SubpassContents::eInline);
+    }
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                               pass.pipeline);
+    commandBuffer.bindDescriptorSets(
+        vk::PipelineBindPoint::eGraphics, pipelineLayout, 0,
+        renderGraph.descriptorSet(pass.graphPass, currentFrame, frameNumber),
+        nullptr);
+    bindShaderInputs(commandBuffer, vk::PipelineBindPoint::eGraphics,
+                     pipelineLayout, 1, output);
+    // Full-screen triangle generated from gl_VertexIndex.
+    commandBuffer.draw(3, 1, 0, 0);
+
+    if (direct) {
+      commandBuffer.endRenderPass();
+    }
+    renderGraph.endPass(commandBuffer, pass.graphPass);
+    if (last && !direct) {
+      blitOutput(commandBuffer, imageIndex);
+    }
+    profiler.endGpuScope(commandBuffer, currentFrame);
+  }
+  if (accumulator && accumulator->wantsReadback()) {
+    accumulator->recordReadback(
+        commandBuffer, currentFrame,
+        renderGraph.transferSource(commandBuffer, accumulationImage,
+                                   frameNumber));
+  }
+  if (exportSlot) {
+    exporter->recordCopy(commandBuffer, *exportSlot,
+                         swapchainImages[imageIndex],
+                         options.headless ? vk::ImageLayout::eTransferSrcOptimal
+                                          : vk::ImageLayout::ePresentSrcKHR);
+  }
+  profiler.endGpuScope(commandBuffer, currentFrame);
+  commandBuffer.end();
+}
+
+void VulkanApp::bindShaderInputs(vk::CommandBuffer commandBuffer,
+                                 vk::PipelineBindPoint bindPoint,
+                                 vk::PipelineLayout layout, uint32_t set,
+                                 bool output) {
+  if (!inputRing.buffer) {
+    commandBuffer.pushConstants<ShaderInputs>(
+        layout, vk::ShaderStageFlagBits::eAll, 0,
+        output ? outputInputs : shaderInputs);
+    return;
+  }
+  const auto offset = static_cast<uint32_t>((currentFrame * 2 + output) *
+                                            inputRing.stride);
+  commandBuffer.bindDescriptorSets(bindPoint, layout, set, inputRing.set,
+                                   offset);
+}
+
+void VulkanApp::blitOutput(vk::CommandBuffer commandBuffer,
+                           uint32_t imageIndex) {
+  auto source =
+      renderGraph.transferSource(commandBuffer, outputImage, frameNumber);
+  auto target = swapchainImages[imageIndex];
+  const auto colorRange =
+      vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+  const auto finalLayout = options.headless
+                               ? vk::ImageLayout::eTransferSrcOptimal
+                               : vk::ImageLayout::ePresentSrcKHR;
+
+  // The source scope chains with the acquire semaphore wait.
+  auto toTransfer = vk::ImageMemoryBarrier()
+                        .setOldLayout(vk::ImageLayout::eUndefined)
+                        .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+                        .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+                        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                        .setImage(target)
+                        .setSubresourceRange(colorRange);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eTransfer, {},
+                                nullptr, nullptr, toTransfer);
+
+  const auto layers =
+      vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+  const std::array sourceOffsets = {
+      vk::Offset3D(0, 0, 0),
+      vk::Offset3D(static_cast<int32_t>(outputExtent.width),
+                   static_cast<int32_t>(outputExtent.height), 1)};
+  const std::array targetOffsets = {
+      vk::Offset3D(0, 0, 0),
+      vk::Offset3D(static_cast<int32_t>(width), static_cast<int32_t>(height),
+                   1)};
+  auto blit = vk::ImageBlit()
+                  .setSrcSubresource(layers)
+                  .setSrcOffsets(sourceOffsets)
+                  .setDstSubresource(layers)
+                  .setDstOffsets(targetOffsets);
+  // Bilinear upscaling; fp16 images are guaranteed to be linearly filterable.
+  const bool scaled =
+      outputExtent.width != width || outputExtent.height != height;
+  commandBuffer.blitImage(source, vk::ImageLayout::eTransferSrcOptimal, target,
+                          vk::ImageLayout::eTransferDstOptimal, blit,
+                          scaled ? vk::Filter::eLinear : vk::Filter::eNearest);
+
+  auto toFinal = vk::ImageMemoryBarrier()
+                     .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+                     .setNewLayout(finalLayout)
+                     .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                     .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                     .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                     .setImage(target)
+                     .setSubresourceRange(colorRange);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eBottomOfPipe, {},
+                                nullptr, nullptr, toFinal);
+}
+
+// Runs once per frame after the slot's fence, so the slot's ring entry is
+// free. Nothing here allocates.
+void VulkanApp::updateShaderInputs() {
+  // Every tile of a still sees the inputs of its first frame.
+  const uint64_t inputFrame =
+      options.firstFrame + (options.tileSize ? 0 : frameNumber);
+  const bool fixedTime = options.timeStep > 0.0f || options.tileSize;
+  const double previousTime = shaderTime;
+  // Every sample of an accumulated image shows the same moment.
+  if (!accumulator || accumulator->sample() == 0) {
+    shaderTime =
+        fixedTime
+            ? inputFrame * static_cast<double>(options.timeStep)
+            : std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            startTime)
+                  .count();
+  }
+
+  auto &inputs = shaderInputs;
+  if (options.tileSize) {
+    const uint32_t columns = (options.width + width - 1) / width;
+    inputs.iResolution[0] = static_cast<float>(options.width);
+    inputs.iResolution[1] = static_cast<float>(options.height);
+    inputs.fragOffset[0] = static_cast<float>(frameNumber % columns * width);
+    inputs.fragOffset[1] = static_cast<float>(frameNumber / columns * height);
+  } else {
+    inputs.iResolution[0] = static_cast<float>(width);
+    inputs.iResolution[1] = static_cast<float>(height);
+  }
+  inputs.iResolution[2] = 1.0f;
+  inputs.iTime = static_cast<float>(shaderTime);
+  inputs.iTimeDelta =
+      inputFrame == options.firstFrame
+          ? options.timeStep
+          : static_cast<float>(shaderTime - previousTime);
+  inputs.iFrameRate = inputs.iTimeDelta > 0.0f ? 1.0f / inputs.iTimeDelta
+                                               : 0.0f;
+  inputs.iFrame = static_cast<int32_t>(inputFrame);
+
+  float previousMouse[4];
+  std::memcpy(previousMouse, inputs.iMouse, sizeof(previousMouse));
+  int windowWidth = 0, windowHeight = 0;
+  if (window) {
+    glfwGetWindowSize(window, &windowWidth, &windowHeight);
+  }
+  // Minimized windows have no size.
+  if (windowWidth > 0 && windowHeight > 0) {
+    double cursorX, cursorY;
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+    // Pixels with the origin at the bottom left, like fragCoord.
+    const float x = static_cast<float>(cursorX * width / windowWidth);
+    const float y =
+        height - static_cast<float>(cursorY * height / windowHeight);
+    const bool down =
+        glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    const bool clicked = down && !mouseDown;
+    if (clicked) {
+      mouseClick[0] = x, mouseClick[1] = y;
+    }
+    if (down) {
+      inputs.iMouse[0] = x, inputs.iMouse[1] = y;
+    }
+    inputs.iMouse[2] = down ? mouseClick[0] : -mouseClick[0];
+    inputs.iMouse[3] = clicked ? mouseClick[1] : -mouseClick[1];
+    mouseDown = down;
+  }
+  if (accumulator) {
+    // Shaders look around with the mouse, which invalidates the sum. One
+    // that never reads iMouse keeps its samples.
+    if (inputUse.mouse &&
+        std::memcmp(inputs.iMouse, previousMouse, sizeof(previousMouse))) {
+      accumulator->reset();
+    }
+    inputs.iSample = static_cast<int32_t>(accumulator->sample());
+  }
+
+  if (fixedTime) {
+    // A fixed date keeps reproducible runs reproducible.
+    inputs.iDate[0] = 2000.0f, inputs.iDate[1] = 0.0f, inputs.iDate[2] = 1.0f;
+    inputs.iDate[3] = static_cast<float>(shaderTime);
+  } else {
+    const auto now = std::chrono::system_clock::now();
+    const std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+    const double fraction = std::chrono::duration<double>(
+                                now - std::chrono::system_clock::from_time_t(
+                                          seconds))
+                                .count();
+    inputs.iDate[0] = static_cast<float>(local.tm_year + 1900);
+    inputs.iDate[1] = static_cast<float>(local.tm_mon);
+    inputs.iDate[2] = static_cast<float>(local.tm_mday);
+    inputs.iDate[3] = static_cast<float>(
+        local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec + fraction);
+  }
+
+  // A scaled Image pass sees its own render size, with the mouse scaled to
+  // it.
+  outputExtent = vk::Extent2D(width, height);
+  outputInputs = inputs;
+  if (resolutionScaler) {
+    outputExtent = resolutionScaler->extent(outputExtent);
+    const float scaleX = static_cast<float>(outputExtent.width) / width;
+    const float scaleY = static_cast<float>(outputExtent.height) / height;
+    outputInputs.iResolution[0] = static_cast<float>(outputExtent.width);
+    outputInputs.iResolution[1] = static_cast<float>(outputExtent.height);
+    for (int i = 0; i < 4; i += 2) {
+      outputInputs.iMouse[i] *= scaleX;
+      outputInputs.iMouse[i + 1] *= scaleY;
+    }
+  }
+
+  if (inputRing.data) {
+    auto entry = inputRing.data + currentFrame * 2 * inputRing.stride;
+    std::memcpy(entry, &inputs, sizeof(inputs));
+    std::memcpy(entry + inputRing.stride, &outputInputs, sizeof(outputInputs));
+  }
+}
+
+void VulkanApp::drawFrame() {
+  auto &frame = frames[currentFrame];
+  {
+    Profiler::CpuScope scope(profiler, "wait");
+    if (device.waitForFences(frame.inFlight, VK_TRUE, UINT64_MAX) !=
+        vk::Result::eSuccess) {
+      throw std::runtime_error("Wait for in-flight frame failed.");
+    }
+  }
+  {
+    Profiler::CpuScope scope(profiler, "pace");
+    paceFrame();
+  }
+  const auto gpuFrameMs = profiler.collect(currentFrame);
+  if (resolutionScaler && gpuFrameMs) {
+    resolutionScaler->update(*gpuFrameMs);
+  }
+  if (accumulator) {
+    accumulator->collect(currentFrame);
+  }
+  // Both can restart an accumulation, so they go before the inputs.
+  swapPipelines();
+  {
+    // Finished textures replace their placeholders; the graph rebinds them
+    // in each slot once that slot is free.
+    Profiler::CpuScope scope(profiler, "textures");
+    textures->update([this](TextureLoader::TextureId id, vk::ImageView view) {
+      renderGraph.setExternalView(textureImages[id], view);
+      if (accumulator) {
+        accumulator->reset();
+      }
+    });
+  }
+  updateShaderInputs();
+  // Hands this slot's last export over before its fence is reset.
+  if (exporter) {
+    exporter->poll();
+  }
+
+  currentImage = currentFrame;
+  if (!options.headless) {
+    Profiler::CpuScope scope(profiler, "acquire");
+    try {
+      auto acquired = device.acquireNextImageKHR(swapchain, UINT64_MAX,
+                                                 frame.imageAvailable, nullptr);
+      currentImage = acquired.value;
+      // A suboptimal swapchain can still present this frame; it is rebuilt
+      // right after.
+      swapchainStale |= acquired.result == vk::Result::eSuboptimalKHR;
+    } catch (const vk::OutOfDateKHRError &) {
+      // Nothing was signalled or reset, so the slot can simply be retried.
+      recreateSwapChain();
+      return;
+    }
+  }
+  // The swapchain may hand out images in any order, so an image can still be
+  // in use by a different slot than the one we are about to record.
+  if (imagesInFlight[currentImage] &&
+      imagesInFlight[currentImage] != frame.inFlight) {
+    if (device.waitForFences(imagesInFlight[currentImage], VK_TRUE,
+                             UINT64_MAX) != vk::Result::eSuccess) {
+      throw std::runtime_error("Wait for swapchain image failed.");
+    }
+  }
+  imagesInFlight[currentImage] = frame.inFlight;
+
+  // An accumulated image is only exported once it is complete.
+  exportSlot.reset();
+  if (exporter && (!accumulator || accumulator->finishing())) {
+    Profiler::CpuScope scope(profiler, "export");
+    exportSlot = exporter->acquire();
+  }
+  {
+    Profiler::CpuScope scope(profiler, "record");
+    frame.commandBuffer.reset();
+    recordCommandBuffer(frame.commandBuffer, currentImage);
+  }
+
+  // A compute Image pass first touches the target with its blit.
+  vk::PipelineStageFlags waitStage =
+      vk::PipelineStageFlagBits::eColorAttachmentOutput |
+      vk::PipelineStageFlagBits::eTransfer;
+  auto submitInfo = vk::SubmitInfo().setCommandBuffers(frame.commandBuffer);
+  if (!options.headless) {
+    submitInfo.setWaitSemaphores(frame.imageAvailable)
+        .setWaitDstStageMask(waitStage)
+        .setSignalSemaphores(renderFinished[currentImage]);
+  }
+  {
+    Profiler::CpuScope scope(profiler, "submit");
+    device.resetFences(frame.inFlight);
+    std::lock_guard lock(*queueMutex);
+    graphicQueue.submit(submitInfo, frame.inFlight);
+  }
+  if (exportSlot) {
+    exporter->submitted(*exportSlot, options.firstFrame + exportedFrames++,
+                        frame.inFlight);
+  }
+  if (accumulator) {
+    accumulator->advance();
+  }
+
+  if (!options.headless) {
+    Profiler::CpuScope scope(profiler, "present");
+    present();
+  }
+  currentFrame = (currentFrame + 1) % frames.size();
+  frameNumber++;
+}
+
+void VulkanApp::watchShaders() {
+  std::vector<std::string> paths;
+  for (const auto &pass : passes) {
+    if (!pass.source) {
+      paths.push_back(pass.shader);
+    }
+  }
+  if (!options.vertexShader.empty()) {
+    paths.push_back(options.vertexShader);
+  }
+  if (!options.specConfig.empty()) {
+    paths.push_back(options.specConfig);
+  }
+  shaderWatcher = std::make_unique<ShaderWatcher>(
+      std::move(paths), [this]() { reloadShaders(); });
+}
+
+// Runs on the watcher thread; the render thread keeps drawing with the
+// current pipeline until swapPipelines() picks up the new one.
+void VulkanApp::reloadShaders() {
+  try {
+    auto vertexCode = shaderCompiler.load(options.vertexShader,
+                                          vk::ShaderStageFlagBits::eVertex);
+    const auto values = specValues();
+    // Rebuild every pass so a failing one leaves all of them untouched.
+    // Variants built before the failure stay cached for the next attempt.
+    std::vector<vk::Pipeline> newPipelines;
+    InputUse use = reflectInputs(vertexCode.code());
+    for (const auto &pass : passes) {
+      newPipelines.push_back(buildPassPipeline(vertexCode, pass, values, use));
+    }
+
+    std::lock_guard lock(reloadMutex);
+    evictStaleVariants(newPipelines);
+    pendingPipelines = std::move(newPipelines);
+    pendingInputUse = use;
+    std::cerr << "[hot reload] Shaders rebuilt\n";
+    if (window) {
+      // Wakes a main loop that is waiting for events.
+      glfwPostEmptyEvent();
+    }
+  } catch (const std::exception &e) {
+    std::cerr << std::format("[hot reload] {}\n", e.what());
+  }
+}
+
+void VulkanApp::evictStaleVariants(const std::vector<vk::Pipeline> &current) {
+  std::lock_guard lock(variantMutex);
+  std::unordered_set<uint64_t> liveShaders;
+  for (const auto &[key, variant] : pipelineVariants) {
+    if (std::ranges::find(current, variant.pipeline) != current.end()) {
+      liveShaders.insert(variant.shaderHash);
+    }
+  }
+  // Other specializations of live shaders stay, so switching back is free.
+  std::erase_if(pipelineVariants, [&](const auto &entry) {
+    if (liveShaders.contains(entry.second.shaderHash)) {
+      return false;
+    }
+    evictedPipelines.push_back(entry.second.pipeline);
+    return true;
+  });
+}
+
+void VulkanApp::swapPipelines() {
+  // The current slot's fence has been waited on, so every frame up to
+  // frameNumber - frames.size() has finished on the GPU.
+  std::erase_if(retiredPipelines, [this](const RetiredPipeline &retired) {
+    if (retired.lastFrame + frames.size() > frameNumber) {
+      return false;
+    }
+    device.destroyPipeline(retired.pipeline);
+    return true;
+  });
+
+  std::lock_guard lock(reloadMutex);
+  if (accumulator && !pendingPipelines.empty()) {
+    accumulator->reset();
+  }
+  if (!pendingPipelines.empty()) {
+    inputUse = pendingInputUse;
+  }
+  for (std::size_t i = 0; i < pendingPipelines.size(); i++) {
+    passes[i].pipeline = pendingPipelines[i];
+  }
+  pendingPipelines.clear();
+  for (auto pipeline : evictedPipelines) {
+    retiredPipelines.push_back({pipeline, frameNumber});
+  }
+  evictedPipelines.clear();
+}
+
 void VulkanApp::present() {
   auto presentInfo = vk::PresentInfoKHR()
+                         .setWaitSemaphores(renderFinished[currentImage])
                          .setImageIndices(currentImage)
                          .setSwapchainCount(1)
                          .setPSwapchains(&swapchain);
-  if (graphicQueue.presentKHR(presentInfo) != vk::Result::eSuccess) {
-    throw std::runtime_error("Set present KHR failed.");
+  vk::Result result;
+  try {
+    std::lock_guard lock(*queueMutex);
+    result = graphicQueue.presentKHR(presentInfo);
+  } catch (const vk::OutOfDateKHRError &) {
+    result = vk::Result::eErrorOutOfDateKHR;
+  }
+  if (result != vk::Result::eSuccess || swapchainStale) {
+    recreateSwapChain();
   }
 }
 
+void VulkanApp::recreateSwapChain() {
+  // A minimized window has nothing to present to until it comes back.
+  int w = 0, h = 0;
+  glfwGetFramebufferSize(window, &w, &h);
+  while ((w == 0 || h == 0) && !glfwWindowShouldClose(window)) {
+    glfwWaitEvents();
+    glfwGetFramebufferSize(window, &w, &h);
+  }
+  device.waitIdle();
+  swapchainStale = false;
+
+  for (auto framebuffer : swapChainFramebuffers) {
+    device.destroyFramebuffer(framebuffer);
+  }
+  for (auto view : swapchainIamgesViews) {
+    device.destroyImageView(view);
+  }
+  for (auto semaphore : renderFinished) {
+    device.destroySemaphore(semaphore);
+  }
+
+  const auto previousWidth = width, previousHeight = height;
+  createSwapChain();
+  createImageView();
+  createFrambuffers();
+  createImageSyncObjects();
+  // The new images hold nothing to show yet.
+  redrawRequested = true;
+  if (accumulator) {
+    accumulator->reset();
+  }
+  if (width == previousWidth && height == previousHeight) {
+    return;
+  }
+  if (exporter) {
+    throw std::runtime_error("Window size changed while exporting.");
+  }
+  // Pipelines stay valid: the graph's new render passes are compatible with
+  // the old ones. Buffer contents start over, as on ShaderToy.
+  renderGraph.destroy();
+  compileRenderGraph();
+  if (accumulator) {
+    createAccumulator();
+  }
+}
+
+// Sleeping before the inputs are sampled rather than after present keeps
+// them as fresh as possible when the frame is finally shown.
+void VulkanApp::paceFrame() {
+  if (options.targetFps == 0) {
+    return;
+  }
+  const auto interval =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(1.0 / options.targetFps));
+  auto now = std::chrono::steady_clock::now();
+  if (now < nextFrameStart) {
+    std::this_thread::sleep_until(nextFrameStart);
+  } else if (now - nextFrameStart > interval) {
+    // Too far behind to catch up; start a new schedule.
+    nextFrameStart = now;
+  }
+  nextFrameStart += interval;
+}
+
 /** GLFW **/
 void VulkanApp::initWindow() {
-  glfwInit();
+  if (!glfwInit()) {
+    throw std::runtime_error("Init GLFW failed.");
+  }
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-  window =
-      glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Shader Toy", nullptr, nullptr);
-  hwnd = glfwGetWin32Window(window);
-  hInstance = GetModuleHandle(nullptr);
+  // Exported streams keep the size they started with.
+  glfwWindowHint(GLFW_RESIZABLE,
+                 options.exportPath.empty() ? GLFW_TRUE : GLFW_FALSE);
+  window = glfwCreateWindow(options.width, options.height, "Vulkan Shader Toy",
+                            nullptr, nullptr);
+  // Not every platform reports a resize through out-of-date swapchains.
+  glfwSetWindowUserPointer(window, this);
+  glfwSetFramebufferSizeCallback(window, [](GLFWwindow *window, int, int) {
+    static_cast<VulkanApp *>(glfwGetWindowUserPointer(window))
+        ->swapchainStale = true;
+  });
+  // Events that may change a frame rendered on demand.
+  glfwSetWindowRefreshCallback(window, [](GLFWwindow *window) {
+    static_cast<VulkanApp *>(glfwGetWindowUserPointer(window))
+        ->redrawRequested = true;
+  });
+  glfwSetMouseButtonCallback(window, [](GLFWwindow *window, int, int, int) {
+    auto *app = static_cast<VulkanApp *>(glfwGetWindowUserPointer(window));
+    app->redrawRequested |= app->inputUse.mouse;
+  });
+  // iMouse only follows the cursor while the button is held.
+  glfwSetCursorPosCallback(window, [](GLFWwindow *window, double, double) {
+    auto *app = static_cast<VulkanApp *>(glfwGetWindowUserPointer(window));
+    app->redrawRequested |=
+        app->inputUse.mouse &&
+        glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+  });
   int w, h;
   glfwGetWindowSize(window, &w, &h);
   width = w, height = h;
 }
 void VulkanApp::mainLoop() {
+  if (options.headless) {
+    for (uint32_t i = 0; i < options.frames; i++) {
+      if (accumulator && accumulator->finished()) {
+        break;
+      }
+      drawFrame();
+    }
+    return;
+  }
   while (!glfwWindowShouldClose(window)) {
+    if (accumulationIdle() || onDemandIdle()) {
+      glfwWaitEvents();
+      continue;
+    }
     glfwPollEvents();
+    drawFrame();
   }
 }
+
+bool VulkanApp::onDemandIdle() {
+  // Exports and resolution scaling want a steady stream of frames.
+  if (options.continuous || exporter || resolutionScaler || inputUse.time ||
+      renderGraph.hasFeedback()) {
+    return false;
+  }
+  bool changed = std::exchange(redrawRequested, false) || swapchainStale ||
+                 textures->loading();
+  // The frame after a click clears its flag in iMouse.w.
+  changed |= inputUse.mouse && shaderInputs.iMouse[3] > 0.0f;
+  std::lock_guard lock(reloadMutex);
+  return !changed && pendingPipelines.empty();
+}
+
+bool VulkanApp::accumulationIdle() {
+  if (!accumulator || !accumulator->finished()) {
+    return false;
+  }
+  bool changed =
+      swapchainStale ||
+      (inputUse.mouse &&
+       glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS);
+  {
+    std::lock_guard lock(reloadMutex);
+    changed |= !pendingPipelines.empty();
+  }
+  if (changed) {
+    accumulator->reset();
+  }
+  return !changed;
+}
+void VulkanApp::finishFrames() {
+  // Only this app's own work: the device may be shared.
+  std::vector<vk::Fence> fences;
+  for (const auto &frame : frames) {
+    if (frame.inFlight) {
+      fences.push_back(frame.inFlight);
+    }
+  }
+  if (!fences.empty() &&
+      device.waitForFences(fences, VK_TRUE, UINT64_MAX) !=
+          vk::Result::eSuccess) {
+    throw std::runtime_error("Wait for in-flight frames failed.");
+  }
+  for (uint32_t i = 0; i < frames.size(); i++) {
+    profiler.collect(i);
+  }
+}
+
 void VulkanApp::cleanup() {
+  // init() may have thrown part way, even before there was a device.
+  if (device) {
+    destroyResources();
+  }
+  if (!sharedDevice) {
+    destroyDevice();
+  }
 
-  glfwDestroyWindow(window);
-  glfwTerminate();
+  if (window) {
+    glfwDestroyWindow(window);
+    glfwTerminate();
+  }
 }
 
-void VulkanApp::run() {
-  initWindow();
+void VulkanApp::destroyResources() {
+  finishFrames();
+
+  if (options.profile) {
+    profiler.report(std::cout);
+    if (allocator) {
+      allocator->report(std::cout);
+    }
+    if (resolutionScaler) {
+      std::cout << std::format("[resolution] final scale {:.3f}\n",
+                               resolutionScaler->scale());
+    }
+    if (!options.tracePath.empty()) {
+      profiler.writeTrace(options.tracePath);
+    }
+  }
+  profiler.destroy();
+  // Waits for the encoders to finish the remaining frames.
+  exporter.reset();
+  accumulator.reset();
+  textures.reset();
+
+  for (auto &frame : frames) {
+    device.destroySemaphore(frame.imageAvailable);
+    device.destroyFence(frame.inFlight);
+  }
+  for (auto semaphore : renderFinished) {
+    device.destroySemaphore(semaphore);
+  }
+  device.destroyCommandPool(commandPool);
+  for (auto framebuffer : swapChainFramebuffers) {
+    device.destroyFramebuffer(framebuffer);
+  }
+  shaderWatcher.reset();
+  for (const auto &[key, variant] : pipelineVariants) {
+    device.destroyPipeline(variant.pipeline);
+  }
+  for (auto pipeline : evictedPipelines) {
+    device.destroyPipeline(pipeline);
+  }
+  for (const auto &retired : retiredPipelines) {
+    device.destroyPipeline(retired.pipeline);
+  }
+  for (auto hash : acquiredModules) {
+    shaderModules->release(hash);
+  }
+  acquiredModules.clear();
+  device.destroyPipelineLayout(pipelineLayout);
+  device.destroyPipelineLayout(computePipelineLayout);
+  renderGraph.destroy();
+  device.destroyDescriptorSetLayout(descriptorSetLayout);
+  device.destroyDescriptorSetLayout(storageSetLayout);
+  if (inputRing.buffer) {
+    device.destroyDescriptorPool(inputRing.pool);
+    device.destroyDescriptorSetLayout(inputRing.setLayout);
+    device.destroyBuffer(inputRing.buffer);
+    allocator->free(inputRing.memory);
+  }
+  device.destroyRenderPass(renderPass);
+  for (auto view : swapchainIamgesViews) {
+    device.destroyImageView(view);
+  }
+  if (options.headless) {
+    for (auto image : swapchainImages) {
+      device.destroyImage(image);
+    }
+    for (const auto &memory : offscreenMemory) {
+      allocator->free(memory);
+    }
+  } else {
+    device.destroySwapchainKHR(swapchain);
+  }
+}
+
+void VulkanApp::init() {
+  if (options.headless && options.tileSize) {
+    // The render target holds one tile; iResolution stays the full size.
+    width = std::min(options.tileSize, options.width);
+    height = std::min(options.tileSize, options.height);
+  } else if (options.headless) {
+    width = options.width, height = options.height;
+  } else {
+    initWindow();
+  }
   initVulkan();
+  if (options.watchShaders) {
+    watchShaders();
+  }
+  startTime = std::chrono::steady_clock::now();
+}
+
+void VulkanApp::run() {
+  init();
   mainLoop();
   cleanup();
 }
\ No newline at end of file
@@ -1,68 +1,310 @@
 #pragma once
 
-#define VK_USE_PLATFORM_WIN32_KHR
+#include "accumulator.hpp"
+#include "frame_exporter.hpp"
+#include "memory_allocator.hpp"
+#include "options.hpp"
+#include "pipeline_cache.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+#include "resolution_scaler.hpp"
+#include "shader.hpp"
+#include "shader_compiler.hpp"
+#include "shader_inputs.hpp"
+#include "shader_watcher.hpp"
+#include "spec_constants.hpp"
+#include "texture_loader.hpp"
+#include "validation_log.hpp"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <vulkan/vulkan.hpp>
 
 class VulkanApp {
 public:
+  explicit VulkanApp(const AppOptions &options = {});
+  // A headless app rendering on `owner`'s device, which must have run
+  // initDevice() and must outlive it. Queue submissions of apps sharing a
+  // device are serialized, so each can run on its own thread.
+  VulkanApp(const AppOptions &options, VulkanApp &owner);
+
   void initVulkan();
+  // The instance, device, queues, allocator and caches. Part of
+  // initVulkan() unless the device is borrowed.
+  void initDevice();
+  void destroyDevice();
+  // Everything cleanup() releases besides the device itself.
+  void destroyResources();
 
   void createInstance();
   void setupDebugMessenger();
+  void reloadValidationFilter();
   void createSurface();
   void pickPhysicalDevice();
   void createLogicalDevice();
+  void createPipelineCache();
   void createSwapChain();
+  void createOffscreenTargets();
   void createImageView();
   void createRenderPass();
+  void createDescriptorSetLayout();
+  void createShaderInputs();
+  void createTextureLoader();
+  void createRenderGraph();
+  void compileRenderGraph();
   void createGraphicPipline();
   void createFrambuffers();
+  void createCommandBuffers();
+  void createSyncObjects();
+  // The per-swapchain-image semaphores and fences.
+  void createImageSyncObjects();
+  void createFrameExporter();
+  void createAccumulator();
+  void recordCommandBuffer(vk::CommandBuffer commandBuffer,
+                           uint32_t imageIndex);
+  // Copies the Image pass's graph image to the target, upscaling it when it
+  // was rendered at a reduced scale.
+  void blitOutput(vk::CommandBuffer commandBuffer, uint32_t imageIndex);
+  void updateShaderInputs();
+  void drawFrame();
   void present();
+  // Rebuilds the swapchain after a resize, and the render graph with it.
+  void recreateSwapChain();
+  // Sleeps to hold --fps.
+  void paceFrame();
+  // Whether a finished accumulation can stay on screen; restarts it when
+  // something changed that the image depends on.
+  bool accumulationIdle();
+  // Whether the last frame is still what a new one would show, because
+  // nothing animates and no event changed the inputs since.
+  bool onDemandIdle();
+
+  void watchShaders();
+  void reloadShaders();
+  void swapPipelines();
+  // Moves variants of shaders none of `current` was built from to
+  // evictedPipelines. Needs reloadMutex.
+  void evictStaleVariants(const std::vector<vk::Pipeline> &current);
 
   void initWindow();
   void mainLoop();
+  // Waits for every submitted frame and collects its timings.
+  void finishFrames();
   void cleanup();
+  // init(), then drawFrame() until done, then cleanup().
+  void init();
   void run();
 
+  Profiler &frameProfiler() { return profiler; }
+  vk::PhysicalDeviceProperties deviceProperties() const;
+  // Time spent creating the pipelines built so far, without compiling
+  // their shaders.
+  double pipelineCreationMs() {
+    std::lock_guard lock(variantMutex);
+    return pipelineMs;
+  }
+  // Device-local memory in use by this process, where VK_EXT_memory_budget
+  // is available.
+  std::optional<uint64_t> deviceMemoryUsage() const;
+
 private:
+  AppOptions options;
+
   vk::Instance instance;
   vk::DebugUtilsMessengerEXT debugMessenger;
+  std::unique_ptr<ValidationLog> validationLog;
+  std::unique_ptr<ShaderWatcher> validationWatcher;
+  vk::DispatchLoaderDynamic debugDispatch;
   vk::PhysicalDevice gpu;
   vk::Device device;
   vk::Queue graphicQueue;
+  std::shared_ptr<MemoryAllocator> allocator;
+  // The graphics queue again when there is no separate transfer family.
+  vk::Queue transferQueue;
+  // Held around every submission to either queue.
+  std::shared_ptr<std::mutex> queueMutex;
+  // Borrowed from another app, which destroys it.
+  bool sharedDevice = false;
 
   vk::SurfaceKHR surface;
   std::vector<vk::PresentModeKHR> presentModes;
   std::vector<vk::SurfaceFormatKHR> surfaceFormats;
   vk::SurfaceCapabilitiesKHR surfaceCapabilities;
-  HWND hwnd;
-  HINSTANCE hInstance;
 
   vk::Format format;
   vk::SwapchainKHR swapchain;
+  vk::PresentModeKHR presentMode = vk::PresentModeKHR::eFifo;
+  // Set when the swapchain still works but no longer matches the window.
+  bool swapchainStale = false;
+  std::chrono::steady_clock::time_point nextFrameStart;
+  // In headless mode these hold the offscreen render targets instead.
   std::vector<vk::Image> swapchainImages;
   std::vector<vk::ImageView> swapchainIamgesViews;
+  std::vector<Allocation> offscreenMemory;
   uint32_t currentImage = 0;
   uint32_t frameCount = 0;
   uint32_t width = 0, height = 0;
 
   std::vector<const char *> instanceExtensions;
   std::vector<const char *> deviceExtensions;
+  bool memoryBudget = false;
 
   std::vector<vk::QueueFamilyProperties> queueFamilyProps;
   uint32_t graphicIndex;
+  uint32_t transferIndex;
 
   struct {
     std::vector<vk::VertexInputBindingDescription> bindings;
     std::vector<vk::VertexInputAttributeDescription> attribute_description;
   } vertex;
+  // One per ShaderToy pass, in execution order; the Image pass comes last
+  // and renders into the swapchain (or offscreen) target. A compute Image
+  // pass writes a graph image instead, which is then blitted to the target.
+  // When accumulating, built-in Accumulate and Resolve passes follow it.
+  struct ShaderPass {
+    std::string name;
+    std::string shader;
+    // ShaderToy source of a built-in pass, which has no shader file.
+    const char *source = nullptr;
+    RenderGraph::PassId graphPass;
+    vk::Format format;
+    bool compute = false;
+    // The Image pass.
+    bool output = false;
+    ChannelTypes channels = defaultChannelTypes;
+    vk::Pipeline pipeline;
+  };
+
+  // Which per-frame inputs the shaders read, found by SPIR-V reflection.
+  struct InputUse {
+    // iTime, iTimeDelta, iFrameRate, iFrame, iDate or iSample.
+    bool time = false;
+    bool mouse = false;
+  };
+  static InputUse reflectInputs(std::span<const uint32_t> code);
+
+  // The options' specialization values, re-read from the config file.
+  SpecValues specValues() const;
+  // Adds what the pass's shader reads to `use`.
+  vk::Pipeline buildPassPipeline(const ShaderCode &vertexCode,
+                                 const ShaderPass &pass,
+                                 const SpecValues &values, InputUse &use);
+  vk::Pipeline buildGraphicPipeline(std::span<const uint32_t> vertexCode,
+                                    std::span<const uint32_t> fragmentCode,
+                                    const ShaderPass &pass,
+                                    const SpecValues &values);
+  vk::Pipeline buildComputePipeline(std::span<const uint32_t> code,
+                                    const ShaderPass &pass,
+                                    const SpecValues &values);
+  // The shared module for `code`. The app holds one reference per module,
+  // released in cleanup(). Thread safe.
+  vk::ShaderModule shaderModule(uint64_t hash, std::span<const uint32_t> code);
+  // The pipeline variant for `key`, created with `create` on a miss. Thread
+  // safe; `shaderHash` is what the variant is evicted by.
+  vk::Pipeline
+  pipelineVariant(uint64_t key, uint64_t shaderHash,
+                  const std::function<vk::Pipeline(vk::PipelineCache)> &create);
+  vk::RenderPass passRenderPass(const ShaderPass &pass) const;
+  void bindShaderInputs(vk::CommandBuffer commandBuffer,
+                        vk::PipelineBindPoint bindPoint,
+                        vk::PipelineLayout layout, uint32_t set,
+                        bool output);
+
   vk::RenderPass renderPass;
-  vk::Pipeline pipeline;
+  vk::DescriptorSetLayout descriptorSetLayout;
   vk::PipelineLayout pipelineLayout;
+  vk::DescriptorSetLayout storageSetLayout;
+  vk::PipelineLayout computePipelineLayout;
+  // The Image pass's target when it doesn't render into the swapchain image:
+  // compute Image passes and dynamic resolution.
+  RenderGraph::ImageId outputImage = RenderGraph::noImage;
+  std::optional<ResolutionScaler> resolutionScaler;
+  // Render size of the Image pass this frame.
+  vk::Extent2D outputExtent;
+  // Running sum of the Image pass's samples.
+  RenderGraph::ImageId accumulationImage = RenderGraph::noImage;
+  std::optional<Accumulator> accumulator;
+  std::vector<ShaderPass> passes;
+  RenderGraph renderGraph;
+  std::shared_ptr<PipelineCache> pipelineCache;
+  std::shared_ptr<ShaderModuleCache> shaderModules;
+  std::mutex moduleMutex;
+  std::unordered_set<uint64_t> acquiredModules;
+  ShaderCompiler shaderCompiler;
+
+  struct RetiredPipeline {
+    vk::Pipeline pipeline;
+    uint64_t lastFrame;
+  };
+  // Every pipeline built so far, by pipeline key, so switching back to an
+  // earlier shader or specialization is free. Pass pipelines are owned here.
+  struct PipelineVariant {
+    vk::Pipeline pipeline;
+    uint64_t shaderHash;
+  };
+  std::mutex variantMutex;
+  std::unordered_map<uint64_t, PipelineVariant> pipelineVariants;
+
+  std::unique_ptr<ShaderWatcher> shaderWatcher;
+  std::mutex reloadMutex;
+  std::vector<vk::Pipeline> pendingPipelines;
+  InputUse pendingInputUse;
+  // Variants of shaders no reload uses any more, retired on the next swap.
+  std::vector<vk::Pipeline> evictedPipelines;
+  std::vector<RetiredPipeline> retiredPipelines;
+
+  std::vector<vk::Framebuffer> swapChainFramebuffers;
+
+  struct FrameSlot {
+    vk::CommandBuffer commandBuffer;
+    vk::Semaphore imageAvailable;
+    vk::Fence inFlight;
+  };
+  vk::CommandPool commandPool;
+  std::vector<FrameSlot> frames;
+  std::vector<vk::Semaphore> renderFinished;
+  std::vector<vk::Fence> imagesInFlight;
+  uint32_t currentFrame = 0;
+  uint64_t frameNumber = 0;
+  std::chrono::steady_clock::time_point startTime;
+  // iTime of the frame being recorded, in seconds.
+  double shaderTime = 0.0;
+  ShaderInputs shaderInputs{};
+  // The Image pass's inputs, at its render size.
+  ShaderInputs outputInputs{};
+  bool mouseDown = false;
+  float mouseClick[2] = {};
+  InputUse inputUse;
+  // Set by window and input events that may change the next frame.
+  bool redrawRequested = true;
+  // Only used when ShaderInputs outgrows the push constant limit: two
+  // persistently mapped entries per frame in flight (buffer passes, then the
+  // Image pass), bound with a dynamic offset so nothing is allocated or
+  // updated per frame.
+  struct {
+    vk::DescriptorSetLayout setLayout;
+    vk::DescriptorPool pool;
+    vk::DescriptorSet set;
+    vk::Buffer buffer;
+    Allocation memory;
+    uint8_t *data = nullptr;
+    vk::DeviceSize stride = 0;
+  } inputRing;
+  // Guarded by variantMutex.
+  double pipelineMs = 0.0;
 
-  std::vector<VkFramebuffer> swapChainFramebuffers;
+  Profiler profiler;
+  std::unique_ptr<FrameExporter> exporter;
+  std::unique_ptr<TextureLoader> textures;
+  // Graph images of the textures, by TextureLoader::TextureId.
+  std::vector<RenderGraph::ImageId> textureImages;
+  // Ring slot of the frame being recorded, if it is exported.
+  std::optional<uint32_t> exportSlot;
+  uint64_t exportedFrames = 0;
 
-  static const unsigned WIDTH = 800;
-  static const unsigned HEIGHT = 600;
-  struct GLFWwindow *window;
+  struct GLFWwindow *window = nullptr;
 };
@@ -1,6 +1,6 @@
 add_rules("mode.debug", "mode.release")
 
-add_requires("vulkansdk", "glfw", "glm")
+add_requires("vulkansdk", "glfw", "glm", "shaderc", "stb", "nlohmann_json")
 
 set_warnings("all")
 set_languages("cxx20")
@@ -8,7 +8,27 @@ set_languages("cxx20")
 target("vkShaderToy")
     set_kind("binary")
     add_files("src/*.cpp")
-    add_packages("vulkansdk", "glfw", "glm")
+    add_packages("vulkansdk", "glfw", "glm", "shaderc", "stb")
+
+target("vkShaderToyBench")
+    set_kind("binary")
+    add_files("src/*.cpp|main.cpp", "bench/*.cpp")
+    add_includedirs("src")
+    add_packages("vulkansdk", "glfw", "glm", "shaderc", "stb", "nlohmann_json")
+    -- `xmake test`: a shader that fails to build or a machine without a
+    -- usable device must end up as an "error" result, not a crash.
+    local benchTests = path.join(os.scriptdir(), "bench", "tests")
+    local quickRun = {"--resolutions", "64x64", "--warmup", "0",
+                      "--frames", "2"}
+    add_tests("bad_shader", {
+        runargs = table.join({"--shaders", path.join(benchTests, "bad"),
+                              "--out", "bad_shader.json"}, quickRun)})
+    -- No Vulkan driver manifest, so instance or device creation fails.
+    add_tests("no_device", {
+        runargs = table.join({"--shaders", path.join(benchTests, "valid"),
+                              "--out", "no_device.json"}, quickRun),
+        runenvs = {VK_ICD_FILENAMES = "missing.json",
+                   VK_DRIVER_FILES = "missing.json"}})
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io